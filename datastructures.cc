@@ -3,10 +3,17 @@
 
 #include "datastructures.hh"
 
+#include "tracing.hh"
+
 #include <random>
 
+#include <algorithm>
+
 #include <cmath>
 
+#include <cctype>
+#include <string_view>
+
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
 template <typename Type>
@@ -20,6 +27,287 @@ Type random_in_range(Type start, Type end)
     return static_cast<Type>(start+num);
 }
 
+// Bytes a string has allocated from the heap (zero when it fits in the small string buffer)
+static std::size_t string_heap_bytes(std::string const& str)
+{
+    return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+}
+
+template <typename Type>
+std::size_t vector_bytes(std::vector<Type> const& vec)
+{
+    return vec.capacity() * sizeof(Type);
+}
+
+template <typename Type>
+std::size_t vector_waste(std::vector<Type> const& vec)
+{
+    return (vec.capacity() - vec.size()) * sizeof(Type);
+}
+
+// Bucket array plus one node (next pointer, value and cached hash) per element
+template <typename Map>
+std::size_t hash_table_bytes(Map const& map)
+{
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+// One node (color, parent, left and right) per element
+template <typename Map>
+std::size_t tree_bytes(Map const& map)
+{
+    return map.size() * (sizeof(typename Map::value_type) + 4 * sizeof(void*));
+}
+
+// Division rounded towards negative infinity, so that every grid cell has the same size
+static int floor_div(int dividend, int divisor)
+{
+    int quotient = dividend / divisor;
+    return (dividend % divisor != 0 && dividend < 0) ? quotient - 1 : quotient;
+}
+
+// Affiliation found by a spatial query, with its squared distance to the query point
+struct SpatialCandidate
+{
+    double distance;
+    Coord xy;
+    AffiliationID const* id;
+};
+
+// Closer first, equal distances in the order of y coordinate, x coordinate and ID
+static bool closer(SpatialCandidate const& candidate1, SpatialCandidate const& candidate2)
+{
+    if (candidate1.distance != candidate2.distance) { return candidate1.distance < candidate2.distance; }
+    if (candidate1.xy.y != candidate2.xy.y) { return candidate1.xy.y < candidate2.xy.y; }
+    if (candidate1.xy.x != candidate2.xy.x) { return candidate1.xy.x < candidate2.xy.x; }
+    return *candidate1.id < *candidate2.id;
+}
+
+static double squared_distance(Coord xy1, Coord xy2)
+{
+    double dx = static_cast<double>(xy1.x) - xy2.x;
+    double dy = static_cast<double>(xy1.y) - xy2.y;
+    return dx * dx + dy * dy;
+}
+
+// Words of a title or search terms in lowercase, each word once. Words are the runs of ASCII letters and digits.
+static std::vector<std::string> title_words(std::string const& text)
+{
+    std::vector<std::string> words;
+    std::string word;
+    for (std::size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? text[i] : ' ';
+        if (std::isalnum(c)) {
+            word += static_cast<char>(std::tolower(c));
+        } else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+// Appends value as a varint, seven bits per byte starting from the lowest ones, the high bit set in all but the last byte
+static void put_varint(std::vector<unsigned char>& bytes, unsigned long long value)
+{
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<unsigned char>(value));
+}
+
+// Reads the varint at offset and moves offset past it
+static unsigned long long get_varint(std::vector<unsigned char> const& bytes, std::size_t& offset)
+{
+    unsigned long long value = 0;
+    for (int shift = 0; ; shift += 7) {
+        unsigned char byte = bytes[offset++];
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+// Header of a block of a posting list, the differences of the IDs are in [begin, end)
+struct PostingBlock
+{
+    PublicationID first;
+    PublicationID last;
+    std::size_t begin;
+    std::size_t end;
+};
+
+static PostingBlock read_posting_block(std::vector<unsigned char> const& bytes, std::size_t offset)
+{
+    PostingBlock block;
+    block.first = get_varint(bytes, offset);
+    block.last = block.first + get_varint(bytes, offset);
+    std::size_t length = get_varint(bytes, offset);
+    block.begin = offset;
+    block.end = offset + length;
+    return block;
+}
+
+// Appends the IDs of the block to ids
+static void decode_posting_block(std::vector<unsigned char> const& bytes, PostingBlock const& block, std::vector<PublicationID>& ids)
+{
+    PublicationID id = block.first;
+    ids.push_back(id);
+    std::size_t offset = block.begin;
+    while (offset < block.end) {
+        id += get_varint(bytes, offset);
+        ids.push_back(id);
+    }
+}
+
+// Appends the sorted IDs [begin, end) as one block
+static void encode_posting_block(std::vector<unsigned char>& bytes, PublicationID const* begin, PublicationID const* end)
+{
+    std::vector<unsigned char> deltas;
+    for (PublicationID const* id = begin + 1; id != end; ++id) {
+        put_varint(deltas, *id - *(id - 1));
+    }
+    put_varint(bytes, *begin);
+    put_varint(bytes, *(end - 1) - *begin);
+    put_varint(bytes, deltas.size());
+    bytes.insert(bytes.end(), deltas.begin(), deltas.end());
+}
+
+static std::vector<PublicationID> decode_posting_list(std::vector<unsigned char> const& bytes)
+{
+    std::vector<PublicationID> ids;
+    for (std::size_t offset = 0; offset < bytes.size(); ) {
+        PostingBlock block = read_posting_block(bytes, offset);
+        decode_posting_block(bytes, block, ids);
+        offset = block.end;
+    }
+    return ids;
+}
+
+// Removes the IDs that aren't in the posting list from result, which is sorted. The blocks ending before the next
+// ID of result are skipped by their headers, so a short result is fast against a long list.
+static void intersect_posting_list(std::vector<PublicationID>& result, std::vector<unsigned char> const& bytes)
+{
+    std::size_t kept = 0;
+    std::size_t offset = 0;
+    PostingBlock block = {0, 0, 0, 0};
+    bool headerRead = false;
+    std::vector<PublicationID> ids;
+    std::size_t position = 0;
+    for (PublicationID id : result) {
+        while (offset < bytes.size()) {
+            if (!headerRead) {
+                block = read_posting_block(bytes, offset);
+                headerRead = true;
+                ids.clear();
+            }
+            if (block.last >= id) {
+                break;
+            }
+            offset = block.end;
+            headerRead = false;
+        }
+        if (offset >= bytes.size()) {
+            break;
+        }
+        if (ids.empty()) {
+            decode_posting_block(bytes, block, ids);
+            position = 0;
+        }
+        position = std::lower_bound(ids.begin() + position, ids.end(), id) - ids.begin();
+        if (ids[position] == id) {
+            result[kept++] = id;
+        }
+    }
+    result.resize(kept);
+}
+
+// Distinct trigrams of a name in lowercase, each packed into an integer. Characters other than ASCII letters and digits
+// count as spaces, and the name is padded with two spaces in front and one after, so that the words of the name
+// match also by their first and last letters.
+static std::vector<unsigned int> name_trigrams(std::string const& name)
+{
+    std::string padded = "  ";
+    for (unsigned char c : name) {
+        padded += std::isalnum(c) ? static_cast<char>(std::tolower(c)) : ' ';
+    }
+    padded += ' ';
+
+    std::vector<unsigned int> trigrams;
+    for (std::size_t i = 0; i + 2 < padded.size(); ++i) {
+        trigrams.push_back(static_cast<unsigned char>(padded[i]) << 16 | static_cast<unsigned char>(padded[i + 1]) << 8
+                           | static_cast<unsigned char>(padded[i + 2]));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+// Mixes the bits of value so that every input bit affects every output bit (the splitmix64 finalizer)
+static unsigned long long mix_hash(unsigned long long value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// Hash functions of the MinHash signatures. Function i is h1 + i h2 of the two halves of one hash of the
+// publication, so a publication is hashed only once for the whole signature.
+template <std::size_t Size>
+static std::array<unsigned int, Size> minhashes(PublicationID id)
+{
+    unsigned long long hash = mix_hash(id + 0x9e3779b97f4a7c15ULL);
+    unsigned int hash1 = static_cast<unsigned int>(hash);
+    // An odd step gives different values for all the functions
+    unsigned int hash2 = static_cast<unsigned int>(hash >> 32) | 1;
+    std::array<unsigned int, Size> hashes;
+    for (std::size_t i = 0; i < Size; ++i) {
+        hashes[i] = hash1 + static_cast<unsigned int>(i) * hash2;
+    }
+    return hashes;
+}
+
+// Key of a locality-sensitive hashing bucket, the hash of the band number and the values of the band
+static unsigned long long lsh_key(std::size_t band, unsigned int const* values, std::size_t rows)
+{
+    unsigned long long key = band;
+    for (std::size_t row = 0; row < rows; ++row) {
+        key = mix_hash(key ^ values[row]);
+    }
+    return key;
+}
+
+#ifdef USE_OP_STATS
+// Names of the counted operations, in the order of Datastructures::Operation
+static char const* const OPERATION_NAMES[] = {
+    "get_affiliation_count", "clear_all", "get_all_affiliations", "add_affiliation", "get_affiliation_name",
+    "get_affiliation_coord", "get_affiliations_alphabetically", "get_affiliations_distance_increasing",
+    "find_affiliation_with_coord", "change_affiliation_coord", "add_publication", "all_publications",
+    "get_publication_name", "get_publication_year", "get_affiliations", "add_reference", "get_direct_references",
+    "add_affiliation_to_publication", "get_publications", "get_parent", "get_publications_after",
+    "get_referenced_by_chain", "get_all_references", "get_affiliations_closest_to", "remove_affiliation",
+    "get_closest_common_parent", "remove_publication", "add_affiliations", "add_publications", "memory_usage",
+    "get_affiliations_nearest", "get_affiliations_within", "get_affiliations_in_box",
+    "get_affiliation_changes", "get_affiliation_bounds", "get_collaborators",
+    "get_collaboration_path", "get_collaboration_path_by_distance", "get_citation_count", "get_most_cited",
+    "get_publications_between", "count_publications_between", "get_publication_counts_by_year",
+    "find_affiliations_by_prefix", "search_publications", "find_similar_affiliations",
+    "get_common_publications", "get_common_publications_of", "get_similar_affiliations",
+};
+
+#define COUNT_CALL(operation) counters_.calls[static_cast<std::size_t>(Operation::operation)].fetch_add(1, std::memory_order_relaxed)
+#define COUNT_LOOKUP(found) ((found) ? counters_.lookupHits : counters_.lookupMisses).fetch_add(1, std::memory_order_relaxed)
+#define COUNT_ADD(counter, amount) counters_.counter.fetch_add((amount), std::memory_order_relaxed)
+#else
+#define COUNT_CALL(operation) ((void)0)
+#define COUNT_LOOKUP(found) ((void)0)
+#define COUNT_ADD(counter, amount) ((void)0)
+#endif
+
 Datastructures::Datastructures()
 {
 }
@@ -30,11 +318,15 @@ Datastructures::~Datastructures()
 
 unsigned int Datastructures::get_affiliation_count()
 {
+    COUNT_CALL(GET_AFFILIATION_COUNT);
+    TRACE_SCOPE("get_affiliation_count");
     return affilIDVec.size();
 }
 
 void Datastructures::clear_all()
 {
+    COUNT_CALL(CLEAR_ALL);
+    TRACE_SCOPE("clear_all");
     // Clearing all of the containers in the .hh file
     affiliations.clear();
     publications.clear();
@@ -44,21 +336,51 @@ void Datastructures::clear_all()
     affilIDVec.clear();
     affilIDVecAlph.clear();
     affilIDVecDist.clear();
+    // The name table is rebuilt by the next prefix search
+    nameTableChars.clear();
+    nameTableOffsets.clear();
+    alphabeticallySorted = false;
+    grid.clear();
+    gridRebuildAt = 16;
+    mostCited.clear();
+    citationsCounted = true;
+    yearBuckets.clear();
+    yearCounts.clear();
+    titleIndex.clear();
+    trigramIndex.clear();
+    lshBuckets.clear();
+    lshPending.clear();
+    lshStale.clear();
+
+    // The cleared affiliations aren't logged one by one, the log just can't reach past this version
+    changeLogStart += changeLog.size() + 1;
+    changeLog.clear();
 }
 
 std::vector<AffiliationID> Datastructures::get_all_affiliations()
 {
+    COUNT_CALL(GET_ALL_AFFILIATIONS);
+    TRACE_SCOPE("get_all_affiliations");
+    COUNT_ADD(elementsCopied, affilIDVec.size());
     return affilIDVec;
 }
 
 bool Datastructures::add_affiliation(AffiliationID id, const Name &name, Coord xy)
 {
+    COUNT_CALL(ADD_AFFILIATION);
+    TRACE_SCOPE("add_affiliation");
     // Adding the affiliation to all of the corresponding containers
     auto insertion1 = affiliations.emplace(id, Affiliation{name, xy});
-    affilAlphabetic.emplace(name, id);
-    affilDistIncr.emplace(xy, id);
-    affilIDVec.push_back(id);
+    if (insertion1.second) {
+        grid_insert(id, xy);
+        trigram_index_insert(&*insertion1.first);
+        log_change(id);
+        affilAlphabetic.emplace(name, id);
+        affilDistIncr.emplace(xy, id);
+        affilIDVec.push_back(id);
+    }
 
+    COUNT_ADD(sortedInvalidations, alphabeticallySorted + distIncrSorted);
     // Clearing the sorted vectors and setting the bool values as false
     affilIDVecAlph.clear();
     affilIDVecDist.clear();
@@ -71,8 +393,11 @@ bool Datastructures::add_affiliation(AffiliationID id, const Name &name, Coord x
 
 Name Datastructures::get_affiliation_name(AffiliationID id)
 {
+    COUNT_CALL(GET_AFFILIATION_NAME);
+    TRACE_SCOPE("get_affiliation_name");
     // finding the id in the affiliations map
     auto it = affiliations.find(id);
+    COUNT_LOOKUP(it != affiliations.end());
     if (it != affiliations.end()) {
         // returning the name of the affiliation
         return it->second.name;
@@ -82,8 +407,11 @@ Name Datastructures::get_affiliation_name(AffiliationID id)
 
 Coord Datastructures::get_affiliation_coord(AffiliationID id)
 {
+    COUNT_CALL(GET_AFFILIATION_COORD);
+    TRACE_SCOPE("get_affiliation_coord");
     // finding the id in the affiliations map
     auto it = affiliations.find(id);
+    COUNT_LOOKUP(it != affiliations.end());
     if (it != affiliations.end()) {
         // returning the coordinates of the affiliation
         return it->second.coordinates;
@@ -92,22 +420,39 @@ Coord Datastructures::get_affiliation_coord(AffiliationID id)
 }
 
 std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically()
+{
+    COUNT_CALL(GET_AFFILIATIONS_ALPHABETICALLY);
+    TRACE_SCOPE("get_affiliations_alphabetically");
+    sort_alphabetically();
+
+    COUNT_ADD(elementsCopied, affilIDVecAlph.size());
+    return affilIDVecAlph;
+}
+
+void Datastructures::sort_alphabetically()
 {
     // If the bool value is false, the vector is not sorted and is empty
     if (!alphabeticallySorted) {
-	affilIDVecAlph.reserve(affiliations.size());
-        // Adding all of the ID's from the affilAlphabetic into the vector
+        affilIDVecAlph.reserve(affiliations.size());
+        nameTableChars.clear();
+        nameTableOffsets.clear();
+        nameTableOffsets.reserve(affiliations.size() + 1);
+        // Adding all of the ID's and names from the affilAlphabetic into the vector and the name table
         for (const auto& part : affilAlphabetic) {
             affilIDVecAlph.push_back(part.second);
+            nameTableOffsets.push_back(nameTableChars.size());
+            nameTableChars += part.first;
         }
+        nameTableOffsets.push_back(nameTableChars.size());
         alphabeticallySorted = true;
+        COUNT_ADD(sortedRebuilds, 1);
     }
-
-    return affilIDVecAlph;
 }
 
 std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing()
 {
+    COUNT_CALL(GET_AFFILIATIONS_DISTANCE_INCREASING);
+    TRACE_SCOPE("get_affiliations_distance_increasing");
     // If the bool value is false, the vector is not sorted and is empty
     if (!distIncrSorted) {
         // Adding all of the ID's from the affilAlphabetic into the vector
@@ -115,15 +460,20 @@ std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing(
             affilIDVecDist.push_back(part.second);
         }
         distIncrSorted = true;
+        COUNT_ADD(sortedRebuilds, 1);
     }
 
+    COUNT_ADD(elementsCopied, affilIDVecDist.size());
     return affilIDVecDist;
 }
 
 AffiliationID Datastructures::find_affiliation_with_coord(Coord xy)
 {
+    COUNT_CALL(FIND_AFFILIATION_WITH_COORD);
+    TRACE_SCOPE("find_affiliation_with_coord");
     // Finding the id in the affilDistIncr map
     auto it = affilDistIncr.find(xy);
+    COUNT_LOOKUP(it != affilDistIncr.end());
 
     if (it != affilDistIncr.end()) {
         // Returning the id of the affiliation in the given coordinates
@@ -134,15 +484,23 @@ AffiliationID Datastructures::find_affiliation_with_coord(Coord xy)
 
 bool Datastructures::change_affiliation_coord(AffiliationID id, Coord newcoord)
 {
+    COUNT_CALL(CHANGE_AFFILIATION_COORD);
+    TRACE_SCOPE("change_affiliation_coord");
     auto it1 = affiliations.find(id);
+    COUNT_LOOKUP(it1 != affiliations.end());
     if (it1 != affiliations.end()) {
         // Removing the affiliation from the affilDistIncr map
         auto it2 = affilDistIncr.find(it1->second.coordinates);
         affilDistIncr.erase(it2);
         // Adding the affiliation back with new coordinates
         affilDistIncr.emplace(newcoord ,id);
+        grid_erase(id, it1->second.coordinates);
+        // A rebuild during the insertion indexes the stored coordinates, so they are updated first
         it1->second.coordinates = newcoord;
+        grid_insert(id, newcoord);
+        log_change(id);
 
+        COUNT_ADD(sortedInvalidations, distIncrSorted);
         // Coordinate changed so the affilIDVecDist is no longer sorted
         affilIDVecDist.clear();
         distIncrSorted = false;
@@ -153,20 +511,44 @@ bool Datastructures::change_affiliation_coord(AffiliationID id, Coord newcoord)
 
 bool Datastructures::add_publication(PublicationID id, const Name &name, Year year, const std::vector<AffiliationID> &affiliationsOfPub)
 {
-    auto insertion = publications.emplace(id, Publication{name, year, affiliationsOfPub});
+    COUNT_CALL(ADD_PUBLICATION);
+    TRACE_SCOPE("add_publication");
+    auto insertion = publications.emplace(id, Publication{name, year, existing_affiliations(affiliationsOfPub)});
     publicationVec.push_back(id);
+    if (insertion.second) {
+        const auto& listed = insertion.first->second.affiliationsOfPub;
+        year_index_insert(id, year);
+        title_index_insert(id, name);
+        link_publication(id, year, listed);
+        // A new publication has no citations, so the other counts stay up to date
+        if (citationsCounted) {
+            mostCited.insert({0, id});
+        }
+
+        // Every pair of the publication's affiliations collaborates
+        change_collaborations(listed, 1);
+        for (const auto& affiliationid : listed) {
+            log_change(affiliationid);
+        }
+    }
     // Insertion second is a bool value that is true if the emplacement was successful
     return insertion.second;
 }
 
 std::vector<PublicationID> Datastructures::all_publications()
 {
+    COUNT_CALL(ALL_PUBLICATIONS);
+    TRACE_SCOPE("all_publications");
+    COUNT_ADD(elementsCopied, publicationVec.size());
     return publicationVec;
 }
 
 Name Datastructures::get_publication_name(PublicationID id)
 {
+    COUNT_CALL(GET_PUBLICATION_NAME);
+    TRACE_SCOPE("get_publication_name");
     auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Returning the heading of the publication
         return it->second.heading;
@@ -176,7 +558,10 @@ Name Datastructures::get_publication_name(PublicationID id)
 
 Year Datastructures::get_publication_year(PublicationID id)
 {
+    COUNT_CALL(GET_PUBLICATION_YEAR);
+    TRACE_SCOPE("get_publication_year");
     auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Returning the publish year of the publication
         return it->second.publishYear;
@@ -186,9 +571,13 @@ Year Datastructures::get_publication_year(PublicationID id)
 
 std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id)
 {
+    COUNT_CALL(GET_AFFILIATIONS);
+    TRACE_SCOPE("get_affiliations");
     auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Returning a vector containing all of the publicationID's that reference this publication
+        COUNT_ADD(elementsCopied, it->second.affiliationsOfPub.size());
         return it->second.affiliationsOfPub;
     }
     return {NO_AFFILIATION};
@@ -196,8 +585,12 @@ std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id)
 
 bool Datastructures::add_reference(PublicationID id, PublicationID parentid)
 {
+    COUNT_CALL(ADD_REFERENCE);
+    TRACE_SCOPE("add_reference");
     auto it1 = publications.find(id);
     auto it2 = publications.find(parentid);
+    COUNT_LOOKUP(it1 != publications.end());
+    COUNT_LOOKUP(it2 != publications.end());
 
     // Checking that both the id's exist in the publications map
     if (it1 != publications.end() && it2!=publications.end()) {
@@ -205,11 +598,15 @@ bool Datastructures::add_reference(PublicationID id, PublicationID parentid)
         it1->second.parent.first = parentid;
 
         // Adding the parent publication as a pointer to the child id
-        it1->second.parent.second = &publications.at(parentid);
+        it1->second.parent.second = &it2->second;
 
         // Adding the child id and pointer to the child id
         it2->second.referencesOfPub.push_back(id);
-        it2->second.children.push_back({id, &publications.at(id)});
+        it2->second.children.push_back({id, &it1->second});
+        ++it1->second.timesReferenced;
+
+        // The citations are counted again by the next citation query
+        citationsCounted = false;
         return true;
     }
     return false;
@@ -217,9 +614,13 @@ bool Datastructures::add_reference(PublicationID id, PublicationID parentid)
 
 std::vector<PublicationID> Datastructures::get_direct_references(PublicationID id)
 {
+    COUNT_CALL(GET_DIRECT_REFERENCES);
+    TRACE_SCOPE("get_direct_references");
     auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Returns a vector containing all of the publications that reference this publication
+        COUNT_ADD(elementsCopied, it->second.referencesOfPub.size());
         return publications.at(id).referencesOfPub;
     }
     return {NO_PUBLICATION};
@@ -227,15 +628,28 @@ std::vector<PublicationID> Datastructures::get_direct_references(PublicationID i
 
 bool Datastructures::add_affiliation_to_publication(AffiliationID affiliationid, PublicationID publicationid)
 {
+    COUNT_CALL(ADD_AFFILIATION_TO_PUBLICATION);
+    TRACE_SCOPE("add_affiliation_to_publication");
     auto it1 = affiliations.find(affiliationid);
     auto it2 = publications.find(publicationid);
+    COUNT_LOOKUP(it1 != affiliations.end());
+    COUNT_LOOKUP(it2 != publications.end());
     if (it1 != affiliations.end() && it2!=publications.end()) {
 
+        // The affiliation collaborates with the earlier affiliations of the publication, unless it already did through this publication
+        auto& affiliationsOfPub = it2->second.affiliationsOfPub;
+        if (std::find(affiliationsOfPub.begin(), affiliationsOfPub.end(), affiliationid) == affiliationsOfPub.end()) {
+            change_collaborations(affiliationid, affiliationsOfPub.begin(), affiliationsOfPub.end(), 1);
+        }
+
         // Adding the affiliationID to the publication
-        it2->second.affiliationsOfPub.push_back(affiliationid);
+        affiliationsOfPub.push_back(affiliationid);
 
         // Adding the publicationID as well as the publish year to the affiliation
         it1->second.affiliatedPubs.push_back({publicationid, it2->second.publishYear});
+        posting_insert(it1->second.publicationList, publicationid);
+        minhash_add(&*it1, publicationid);
+        log_change(affiliationid);
         return true;
     }
     return false;
@@ -243,6 +657,8 @@ bool Datastructures::add_affiliation_to_publication(AffiliationID affiliationid,
 
 std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
 {
+    COUNT_CALL(GET_PUBLICATIONS);
+    TRACE_SCOPE("get_publications");
     // Find the affiliation in the affiliations map
     auto it = affiliations.find(id);
 
@@ -250,10 +666,12 @@ std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
     std::vector<PublicationID> affilPubIDs;
 
     // Check if the affiliation exists
+    COUNT_LOOKUP(it != affiliations.end());
     if (it != affiliations.end()) {
         for (const auto& part: it->second.affiliatedPubs) {
             affilPubIDs.push_back(part.first);
         }
+        COUNT_ADD(elementsCopied, affilPubIDs.size());
         return affilPubIDs;
     }
     return {NO_PUBLICATION};
@@ -261,7 +679,10 @@ std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
 
 PublicationID Datastructures::get_parent(PublicationID id)
 {
+    COUNT_CALL(GET_PARENT);
+    TRACE_SCOPE("get_parent");
     auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
     // Checking that the publication has a parent and that it exists
     if (it != publications.end() && it->second.parent.second != nullptr) {
         return it->second.parent.first;
@@ -271,10 +692,13 @@ PublicationID Datastructures::get_parent(PublicationID id)
 
 std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_after(AffiliationID affiliationid, Year year)
 {
+    COUNT_CALL(GET_PUBLICATIONS_AFTER);
+    TRACE_SCOPE("get_publications_after");
     // Find the affiliation in the affiliations map
     auto it = affiliations.find(affiliationid);
 
     // Check if the affiliation exists
+    COUNT_LOOKUP(it != affiliations.end());
     if (it != affiliations.end()) {
         // Vector to store publications after the given year
         std::vector<std::pair<Year, PublicationID>> publicationsAfter;
@@ -301,6 +725,7 @@ std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_af
             return year1 < year2;
         });
         // Return the sorted vector of publications after the given year
+        COUNT_ADD(elementsCopied, publicationsAfter.size());
         return publicationsAfter;
     }
     // If affiliation not found, return a vector with these values
@@ -309,10 +734,13 @@ std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_af
 
 std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID id)
 {
+    COUNT_CALL(GET_REFERENCED_BY_CHAIN);
+    TRACE_SCOPE("get_referenced_by_chain");
     // Find the publication with the given ID in the publications map
     auto it = publications.find(id);
 
     // Check if the publication exists
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Vector to store the chain of publications referencing the given publication
         std::vector<PublicationID> referencedByChain = {};
@@ -336,6 +764,8 @@ std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID
             // Checking if the next one is no publication
             if (nextID == NO_PUBLICATION) {
                 // If no more parent, return vector
+                COUNT_ADD(chainSteps, referencedByChain.size());
+                COUNT_ADD(elementsCopied, referencedByChain.size());
                 return referencedByChain;
             }
 
@@ -346,6 +776,8 @@ std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID
             next = next->parent.second;
         }
 
+        COUNT_ADD(chainSteps, referencedByChain.size());
+        COUNT_ADD(elementsCopied, referencedByChain.size());
         return referencedByChain;
     }
 
@@ -354,10 +786,13 @@ std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID
 
 std::vector<PublicationID> Datastructures::get_all_references(PublicationID id)
 {
+    COUNT_CALL(GET_ALL_REFERENCES);
+    TRACE_SCOPE("get_all_references");
     // Find the publication with the given ID in the publications map
     auto it = publications.find(id);
 
     // Check if the publication exists
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Vector to store the IDs of all references
         std::vector<PublicationID> childrenVec = {};
@@ -368,8 +803,10 @@ std::vector<PublicationID> Datastructures::get_all_references(PublicationID id)
             return childrenVec;
         }
 
-        // Recursively retrieve all references starting from the given publication
-        get_all_references_recursive(it->second, childrenVec);
+        // Retrieve all references starting from the given publication
+        get_all_references_iterative(it->second, childrenVec);
+        COUNT_ADD(chainSteps, childrenVec.size());
+        COUNT_ADD(elementsCopied, childrenVec.size());
         return childrenVec;
     }
     return {NO_PUBLICATION};
@@ -377,67 +814,61 @@ std::vector<PublicationID> Datastructures::get_all_references(PublicationID id)
 
 std::vector<AffiliationID> Datastructures::get_affiliations_closest_to(Coord xy)
 {
-    // Check if there are less than 2 affiliations
-    if (affilIDVec.size() < 2) {
-        // If so, return the existing affiliations
-        return affilIDVec;
-    }
-
-    // Vector to store the closest affiliations
-    std::vector<AffiliationID> closestAffiliations = {};
-
-    // Sort affiliations based on the distance to the given coordinates so the closest ones are first
-    std::sort(affilIDVec.begin(), affilIDVec.end(), [this, &xy] (const auto& ID1, const auto& ID2) {
-        double distance1 = sqrt(pow((affiliations.at(ID1).coordinates.x-xy.x), 2) + pow((affiliations.at(ID1).coordinates.y-xy.y), 2));
-        double distance2 = sqrt(pow((affiliations.at(ID2).coordinates.x-xy.x), 2) + pow((affiliations.at(ID2).coordinates.y-xy.y), 2));
-        return distance1 < distance2;
-    });
-
-    // Check if there are less than 4 affiliations after sorting
-    if (affilIDVec.size() < 4) {
-        // If so, return the whole vector
-        return affilIDVec;
-    }
-
-    // Retrieve the three closest affiliations
-    for (int i = 0; i < 3; ++i) {
-        closestAffiliations.push_back(affilIDVec.at(i));
-    }
-
-    return closestAffiliations;
-
+    COUNT_CALL(GET_AFFILIATIONS_CLOSEST_TO);
+    TRACE_SCOPE("get_affiliations_closest_to");
+    // The three closest affiliations from the grid, or all of them if there are less than three
+    return get_affiliations_nearest(xy, 3);
 }
 
 bool Datastructures::remove_affiliation(AffiliationID id)
 {
+    COUNT_CALL(REMOVE_AFFILIATION);
+    TRACE_SCOPE("remove_affiliation");
     // Find the affiliation with the given ID
     auto it = affiliations.find(id);
 
     // Check if the affiliation exists
+    COUNT_LOOKUP(it != affiliations.end());
     if (it != affiliations.end()) {
         // Remove the affiliation ID from the vector
         affilIDVec.erase(std::remove(affilIDVec.begin(), affilIDVec.end(), id), affilIDVec.end());
 
+        COUNT_ADD(sortedInvalidations, alphabeticallySorted + distIncrSorted);
         // Clear the sorted vectors and set bool values to false
         affilIDVecAlph.clear();
         affilIDVecDist.clear();
         alphabeticallySorted = false;
         distIncrSorted = false;
 
-        // Iterate through affiliated publications and remove the affiliation ID
-        int j = it->second.affiliatedPubs.size();
-        for (int i = 0; i < j; ++i) {
-            publications.at(it->second.affiliatedPubs.at(i).first).affiliationsOfPub.erase(
-                        std::remove(publications.at(it->second.affiliatedPubs.at(i).first).affiliationsOfPub.begin(),
-                                    publications.at(it->second.affiliatedPubs.at(i).first).affiliationsOfPub.end(), id),
-                                    publications.at(it->second.affiliatedPubs.at(i).first).affiliationsOfPub.end());
+        // Remove the affiliation ID from all the publications listing it, including the ones added
+        // with the affiliation by add_publication, so that no publication refers to a removed affiliation
+        for (PublicationID publicationid : decode_posting_list(it->second.publicationList.bytes)) {
+            auto& affiliationsOfPub = publications.at(publicationid).affiliationsOfPub;
+            affiliationsOfPub.erase(std::remove(affiliationsOfPub.begin(), affiliationsOfPub.end(), id), affiliationsOfPub.end());
         }
 
-        // Find and erase the affiliation in alphabetic and distance maps
-        auto it1 = affilAlphabetic.find(it->second.name);
+        // Find and erase the affiliation in alphabetic and distance maps, other
+        // affiliations may have the same name or coordinates
+        auto names = affilAlphabetic.equal_range(it->second.name);
+        auto it1 = std::find_if(names.first, names.second, [&id] (const auto& part) { return part.second == id; });
+        if (it1 != names.second) {
+            affilAlphabetic.erase(it1);
+        }
         auto it2 = affilDistIncr.find(it->second.coordinates);
-        affilAlphabetic.erase(it1);
-        affilDistIncr.erase(it2);
+        if (it2 != affilDistIncr.end() && it2->second == id) {
+            affilDistIncr.erase(it2);
+        }
+
+        grid_erase(id, it->second.coordinates);
+        trigram_index_erase(&*it);
+        lsh_remove(&*it);
+        log_change(id);
+
+        // Removing the affiliation from its collaborators
+        for (const auto& collaborator : it->second.collaborators) {
+            auto& collaborators = collaborator.first->second.collaborators;
+            collaborators.erase(find_collaborator(collaborator.first, &*it));
+        }
 
         // Erase the affiliation from the main affiliations map
         affiliations.erase(id);
@@ -450,11 +881,15 @@ bool Datastructures::remove_affiliation(AffiliationID id)
 
 PublicationID Datastructures::get_closest_common_parent(PublicationID id1, PublicationID id2)
 {
+    COUNT_CALL(GET_CLOSEST_COMMON_PARENT);
+    TRACE_SCOPE("get_closest_common_parent");
     // Find both of the publications
     auto it1 = publications.find(id1);
     auto it2 = publications.find(id2);
 
     // Check that both exist
+    COUNT_LOOKUP(it1 != publications.end());
+    COUNT_LOOKUP(it2 != publications.end());
     if (it1 != publications.end() && it2 != publications.end()) {
         // Get the chain of parent publications for both publications
         std::vector<PublicationID> parents1 = get_referenced_by_chain(id1);
@@ -481,8 +916,11 @@ PublicationID Datastructures::get_closest_common_parent(PublicationID id1, Publi
 
 bool Datastructures::remove_publication(PublicationID publicationid)
 {
+    COUNT_CALL(REMOVE_PUBLICATION);
+    TRACE_SCOPE("remove_publication");
     // Find the publication and check it exists
     auto it = publications.find(publicationid);
+    COUNT_LOOKUP(it != publications.end());
     if (it != publications.end()) {
         // Create a pair for the publication ID and its publish year
         std::pair<PublicationID, Year> pairToRemove = {publicationid, it->second.publishYear};
@@ -494,18 +932,43 @@ bool Datastructures::remove_publication(PublicationID publicationid)
                         std::remove(affiliations.at(it->second.affiliationsOfPub.at(i)).affiliatedPubs.begin(),
                                     affiliations.at(it->second.affiliationsOfPub.at(i)).affiliatedPubs.end(), pairToRemove),
                         affiliations.at(it->second.affiliationsOfPub.at(i)).affiliatedPubs.end());
+            log_change(it->second.affiliationsOfPub.at(i));
         }
 
+        // The affiliations no longer share this publication
+        change_collaborations(it->second.affiliationsOfPub, -1);
+
         // Remove the publication ID from the vector of all publications
         publicationVec.erase(std::remove(publicationVec.begin(), publicationVec.end(), publicationid), publicationVec.end());
 
+        // Remove the publication from the references of its parent, so that the parent
+        // does not keep a pointer to the removed publication
+        Publication* parent = it->second.parent.second;
+        unsigned int unlinked = 0;
+        if (parent != nullptr) {
+            unlinked = unlink_reference(*parent, publicationid);
+        }
+        // A publication that was referenced again is still in the references of its earlier parents,
+        // which are found by going through all the publications
+        if (it->second.timesReferenced > unlinked) {
+            for (auto& other : publications) {
+                unlink_reference(other.second, publicationid);
+            }
+        }
+
         // Update the parent information for the children of the publication
         int k = it->second.children.size();
         for (int i = 0; i < k; ++i) {
             it->second.children.at(i).second->parent = {NO_PUBLICATION,nullptr};
+            --it->second.children.at(i).second->timesReferenced;
         }
 
-        // Remove the publication from the publications map
+        year_index_erase(publicationid, it->second.publishYear);
+        title_index_erase(publicationid, it->second.heading);
+        unlink_publication(publicationid, it->second.affiliationsOfPub);
+
+        // Remove the publication from the publications map, the citations are counted again by the next citation query
+        citationsCounted = false;
         publications.erase(publicationid);
 
         return true;
@@ -513,16 +976,1467 @@ bool Datastructures::remove_publication(PublicationID publicationid)
     return false;
 }
 
-void Datastructures::get_all_references_recursive(const Publication &publication, std::vector<PublicationID> &references)
+unsigned int Datastructures::unlink_reference(Publication &parent, PublicationID id)
+{
+    parent.referencesOfPub.erase(std::remove(parent.referencesOfPub.begin(), parent.referencesOfPub.end(), id),
+                                 parent.referencesOfPub.end());
+    std::size_t before = parent.children.size();
+    parent.children.erase(std::remove_if(parent.children.begin(), parent.children.end(),
+                                         [id] (const auto& child) { return child.first == id; }),
+                          parent.children.end());
+    return before - parent.children.size();
+}
+
+void Datastructures::get_all_references_iterative(const Publication &publication, std::vector<PublicationID> &references)
 {
-    // Iterate over the children of the current publication
-    for (const auto& child : publication.children) {
+    // Explicit stack of publications still to visit instead of recursion,
+    // so that long reference chains cannot overflow the call stack
+    std::vector<std::pair<PublicationID, Publication*>> stack(publication.children.rbegin(), publication.children.rend());
+
+    while (!stack.empty()) {
+        auto child = stack.back();
+        stack.pop_back();
+
         // Add the child's ID to the references vector
         references.push_back(child.first);
 
-        // Recursively call the function for the child's children
-        get_all_references_recursive(*child.second, references);
+        // Visit the child's children next, in the same order as a recursive depth-first search
+        stack.insert(stack.end(), child.second->children.rbegin(), child.second->children.rend());
+    }
+}
+
+unsigned int Datastructures::add_affiliations(const std::vector<AffiliationData> &newAffiliations)
+{
+    COUNT_CALL(ADD_AFFILIATIONS);
+    TRACE_SCOPE("add_affiliations");
+    // Reserving the space for all of the new affiliations at once
+    affiliations.reserve(affiliations.size() + newAffiliations.size());
+    affilIDVec.reserve(affilIDVec.size() + newAffiliations.size());
+
+    unsigned int added = 0;
+    for (const auto& data : newAffiliations) {
+        auto insertion = affiliations.emplace(data.id, Affiliation{data.name, data.xy});
+        if (!insertion.second) {
+            continue;
+        }
+        affilAlphabetic.emplace(data.name, data.id);
+        affilDistIncr.emplace(data.xy, data.id);
+        affilIDVec.push_back(data.id);
+        grid_insert(data.id, data.xy);
+        trigram_index_insert(&*insertion.first);
+        log_change(data.id);
+        ++added;
+    }
+
+    // Clearing the sorted vectors and setting the bool values as false
+    if (added > 0) {
+        COUNT_ADD(sortedInvalidations, alphabeticallySorted + distIncrSorted);
+        affilIDVecAlph.clear();
+        affilIDVecDist.clear();
+        distIncrSorted = false;
+        alphabeticallySorted = false;
+    }
+    return added;
+}
+
+unsigned int Datastructures::add_publications(const std::vector<PublicationData> &newPublications)
+{
+    COUNT_CALL(ADD_PUBLICATIONS);
+    TRACE_SCOPE("add_publications");
+    // Reserving the space for all of the new publications at once
+    publications.reserve(publications.size() + newPublications.size());
+    publicationVec.reserve(publicationVec.size() + newPublications.size());
+
+    unsigned int added = 0;
+    std::vector<bool> inserted(newPublications.size(), false);
+    for (unsigned int i = 0; i < newPublications.size(); ++i) {
+        const auto& data = newPublications[i];
+        auto insertion = publications.emplace(data.id, Publication{data.name, data.year, existing_affiliations(data.affiliations)});
+        if (insertion.second) {
+            const auto& listed = insertion.first->second.affiliationsOfPub;
+            publicationVec.push_back(data.id);
+            inserted[i] = true;
+            ++added;
+            year_index_insert(data.id, data.year);
+            title_index_insert(data.id, data.name);
+            link_publication(data.id, data.year, listed);
+            if (citationsCounted) {
+                mostCited.insert({0, data.id});
+            }
+            change_collaborations(listed, 1);
+            for (const auto& affiliationid : listed) {
+                log_change(affiliationid);
+            }
+        }
+    }
+
+    // References are added only after all of the publications exist,
+    // so that a publication can reference one later in the same batch
+    for (unsigned int i = 0; i < newPublications.size(); ++i) {
+        if (inserted[i] && newPublications[i].parent != NO_PUBLICATION) {
+            add_reference(newPublications[i].id, newPublications[i].parent);
+        }
+    }
+    return added;
+}
+
+MemoryUsage Datastructures::memory_usage()
+{
+    COUNT_CALL(MEMORY_USAGE);
+    TRACE_SCOPE("memory_usage");
+    MemoryUsage usage;
+
+    // Sizes of the containers themselves, excluding the vectors and strings inside the elements
+    usage.containers.push_back({"affiliations", hash_table_bytes(affiliations)});
+    usage.containers.push_back({"publications", hash_table_bytes(publications)});
+    usage.containers.push_back({"affilAlphabetic", tree_bytes(affilAlphabetic)});
+    usage.containers.push_back({"affilDistIncr", tree_bytes(affilDistIncr)});
+    usage.containers.push_back({"affilIDVec", vector_bytes(affilIDVec)});
+    usage.containers.push_back({"affilIDVecAlph", vector_bytes(affilIDVecAlph)});
+    usage.containers.push_back({"nameTableChars", nameTableChars.capacity()});
+    usage.containers.push_back({"nameTableOffsets", vector_bytes(nameTableOffsets)});
+    usage.containers.push_back({"affilIDVecDist", vector_bytes(affilIDVecDist)});
+    usage.containers.push_back({"publicationVec", vector_bytes(publicationVec)});
+    usage.containers.push_back({"grid", hash_table_bytes(grid)});
+    usage.containers.push_back({"changeLog", vector_bytes(changeLog)});
+    usage.containers.push_back({"mostCited", tree_bytes(mostCited)});
+    usage.containers.push_back({"yearBuckets", vector_bytes(yearBuckets)});
+    usage.containers.push_back({"yearCounts", vector_bytes(yearCounts)});
+    usage.vectorWaste += vector_waste(affilIDVec) + vector_waste(affilIDVecAlph)
+                         + vector_waste(affilIDVecDist) + vector_waste(publicationVec) + vector_waste(changeLog);
+
+    // Strings of all the containers are counted separately as the string heap
+    std::size_t stringBytes = 0;
+    for (const auto& id : affilIDVec) { stringBytes += string_heap_bytes(id); }
+    for (const auto& id : affilIDVecAlph) { stringBytes += string_heap_bytes(id); }
+    for (const auto& id : affilIDVecDist) { stringBytes += string_heap_bytes(id); }
+    for (const auto& part : affilAlphabetic) {
+        stringBytes += string_heap_bytes(part.first) + string_heap_bytes(part.second);
+    }
+    for (const auto& part : affilDistIncr) { stringBytes += string_heap_bytes(part.second); }
+    for (const auto& id : changeLog) { stringBytes += string_heap_bytes(id); }
+
+    // Vectors inside the affiliations
+    std::size_t affiliatedPubsBytes = 0;
+    std::size_t collaboratorsBytes = 0;
+    std::size_t publicationListBytes = 0;
+    for (const auto& part : affiliations) {
+        stringBytes += string_heap_bytes(part.first) + string_heap_bytes(part.second.name);
+        affiliatedPubsBytes += vector_bytes(part.second.affiliatedPubs);
+        usage.vectorWaste += vector_waste(part.second.affiliatedPubs);
+        collaboratorsBytes += vector_bytes(part.second.collaborators);
+        usage.vectorWaste += vector_waste(part.second.collaborators);
+        publicationListBytes += vector_bytes(part.second.publicationList.bytes);
+        usage.vectorWaste += vector_waste(part.second.publicationList.bytes);
+    }
+
+    // Vectors inside the publications
+    std::size_t affiliationsOfPubBytes = 0;
+    std::size_t referencesOfPubBytes = 0;
+    std::size_t childrenBytes = 0;
+    for (const auto& part : publications) {
+        const Publication& publication = part.second;
+        stringBytes += string_heap_bytes(publication.heading);
+        for (const auto& id : publication.affiliationsOfPub) { stringBytes += string_heap_bytes(id); }
+        affiliationsOfPubBytes += vector_bytes(publication.affiliationsOfPub);
+        referencesOfPubBytes += vector_bytes(publication.referencesOfPub);
+        childrenBytes += vector_bytes(publication.children);
+        usage.vectorWaste += vector_waste(publication.affiliationsOfPub) + vector_waste(publication.referencesOfPub)
+                             + vector_waste(publication.children);
+    }
+
+    usage.containers.push_back({"Affiliation::affiliatedPubs", affiliatedPubsBytes});
+    usage.containers.push_back({"Affiliation::collaborators", collaboratorsBytes});
+    usage.containers.push_back({"Affiliation::publicationList", publicationListBytes});
+    usage.containers.push_back({"Publication::affiliationsOfPub", affiliationsOfPubBytes});
+    usage.containers.push_back({"Publication::referencesOfPub", referencesOfPubBytes});
+    usage.containers.push_back({"Publication::children", childrenBytes});
+
+    // Cells of the grid
+    std::size_t gridCellBytes = 0;
+    for (const auto& cell : grid) {
+        gridCellBytes += vector_bytes(cell.second);
+        usage.vectorWaste += vector_waste(cell.second);
+        for (const auto& entry : cell.second) { stringBytes += string_heap_bytes(entry.second); }
+    }
+    usage.containers.push_back({"grid cells", gridCellBytes});
+
+    // Publications of each year
+    std::size_t yearBucketBytes = 0;
+    for (const auto& bucket : yearBuckets) {
+        yearBucketBytes += vector_bytes(bucket);
+        usage.vectorWaste += vector_waste(bucket);
+    }
+    usage.containers.push_back({"year buckets", yearBucketBytes});
+
+    // Posting lists of the title index
+    std::size_t postingBytes = 0;
+    for (const auto& term : titleIndex) {
+        stringBytes += string_heap_bytes(term.first);
+        postingBytes += vector_bytes(term.second.bytes);
+        usage.vectorWaste += vector_waste(term.second.bytes);
+    }
+    usage.containers.push_back({"titleIndex", hash_table_bytes(titleIndex)});
+    usage.containers.push_back({"posting lists", postingBytes});
+
+    // Affiliation lists of the trigram index
+    std::size_t trigramListBytes = 0;
+    for (const auto& trigram : trigramIndex) {
+        trigramListBytes += vector_bytes(trigram.second);
+        usage.vectorWaste += vector_waste(trigram.second);
+    }
+    usage.containers.push_back({"trigramIndex", hash_table_bytes(trigramIndex)});
+    usage.containers.push_back({"trigram lists", trigramListBytes});
+
+    usage.containers.push_back({"lshBuckets", vector_bytes(lshBuckets) + vector_bytes(lshPending) + vector_bytes(lshStale)});
+    usage.vectorWaste += vector_waste(lshBuckets) + vector_waste(lshPending) + vector_waste(lshStale);
+    usage.containers.push_back({"string heap", stringBytes});
+
+    usage.loadFactors.push_back({"affiliations", affiliations.load_factor()});
+    usage.loadFactors.push_back({"publications", publications.load_factor()});
+    usage.loadFactors.push_back({"grid", grid.load_factor()});
+    usage.loadFactors.push_back({"titleIndex", titleIndex.load_factor()});
+    usage.loadFactors.push_back({"trigramIndex", trigramIndex.load_factor()});
+
+    return usage;
+}
+
+OperationStats Datastructures::take_operation_stats()
+{
+    OperationStats stats;
+#ifdef USE_OP_STATS
+    static_assert(sizeof(OPERATION_NAMES) / sizeof(OPERATION_NAMES[0]) == static_cast<std::size_t>(Operation::COUNT),
+                  "OPERATION_NAMES must have a name for every Operation");
+    stats.enabled = true;
+    // Reading and resetting each counter at once, so that no call is lost or counted twice
+    for (std::size_t i = 0; i < counters_.calls.size(); ++i) {
+        auto calls = counters_.calls[i].exchange(0, std::memory_order_relaxed);
+        if (calls > 0) {
+            stats.calls.push_back({OPERATION_NAMES[i], calls});
+        }
+    }
+    stats.lookupHits = counters_.lookupHits.exchange(0, std::memory_order_relaxed);
+    stats.lookupMisses = counters_.lookupMisses.exchange(0, std::memory_order_relaxed);
+    stats.sortedRebuilds = counters_.sortedRebuilds.exchange(0, std::memory_order_relaxed);
+    stats.sortedInvalidations = counters_.sortedInvalidations.exchange(0, std::memory_order_relaxed);
+    stats.chainSteps = counters_.chainSteps.exchange(0, std::memory_order_relaxed);
+    stats.elementsCopied = counters_.elementsCopied.exchange(0, std::memory_order_relaxed);
+#endif
+    return stats;
+}
+
+Coord Datastructures::grid_cell(Coord xy) const
+{
+    return {floor_div(xy.x, gridCellSize), floor_div(xy.y, gridCellSize)};
+}
+
+void Datastructures::grid_insert(const AffiliationID &id, Coord xy)
+{
+    // The bounding box starts again from the first affiliation of an empty grid
+    if (grid.empty()) {
+        gridMinCoord = xy;
+        gridMaxCoord = xy;
+    } else {
+        gridMinCoord = {std::min(gridMinCoord.x, xy.x), std::min(gridMinCoord.y, xy.y)};
+        gridMaxCoord = {std::max(gridMaxCoord.x, xy.x), std::max(gridMaxCoord.y, xy.y)};
+    }
+    grid[grid_cell(xy)].push_back({xy, id});
+
+    if (affiliations.size() >= gridRebuildAt) {
+        grid_rebuild();
+    }
+}
+
+void Datastructures::grid_erase(const AffiliationID &id, Coord xy)
+{
+    auto cell = grid.find(grid_cell(xy));
+    if (cell == grid.end()) {
+        return;
+    }
+    auto& entries = cell->second;
+    auto it = std::find_if(entries.begin(), entries.end(), [&id] (const auto& entry) { return entry.second == id; });
+    if (it != entries.end()) {
+        // Order inside a cell doesn't matter, so the last entry can be moved in its place
+        *it = std::move(entries.back());
+        entries.pop_back();
+    }
+    if (entries.empty()) {
+        grid.erase(cell);
+    }
+}
+
+void Datastructures::grid_rebuild()
+{
+    // Checked again when the number of affiliations has doubled, so the rebuilds take O(1) amortized time
+    gridRebuildAt = 2 * affiliations.size();
+
+    // Cells are sized so that there would be about two affiliations per cell if they were spread evenly
+    double width = static_cast<double>(gridMaxCoord.x) - gridMinCoord.x + 1;
+    double height = static_cast<double>(gridMaxCoord.y) - gridMinCoord.y + 1;
+    double target = std::sqrt(2 * width * height / affiliations.size());
+    int cellSize = static_cast<int>(std::max(1.0, std::min(target, 1e9)));
+
+    // Close enough, not worth rebuilding
+    if (cellSize < 2 * gridCellSize && 2 * cellSize > gridCellSize) {
+        return;
+    }
+
+    gridCellSize = cellSize;
+    grid.clear();
+    for (const auto& [id, affiliation] : affiliations) {
+        grid[grid_cell(affiliation.coordinates)].push_back({affiliation.coordinates, id});
+    }
+}
+
+template <typename Func>
+void Datastructures::grid_for_each_in_box(Coord min, Coord max, Func func)
+{
+    if (grid.empty()) {
+        return;
+    }
+    // Cells outside the bounding box are all empty
+    Coord low = grid_cell({std::max(min.x, gridMinCoord.x), std::max(min.y, gridMinCoord.y)});
+    Coord high = grid_cell({std::min(max.x, gridMaxCoord.x), std::min(max.y, gridMaxCoord.y)});
+    if (low.x > high.x || low.y > high.y) {
+        return;
+    }
+
+    auto in_box = [&min, &max] (Coord xy) {
+        return xy.x >= min.x && xy.x <= max.x && xy.y >= min.y && xy.y <= max.y;
+    };
+
+    // Going through the nonempty cells is faster than looking up more cells than that
+    double cells = (static_cast<double>(high.x) - low.x + 1) * (static_cast<double>(high.y) - low.y + 1);
+    if (cells > grid.size()) {
+        for (const auto& cell : grid) {
+            for (const auto& entry : cell.second) {
+                if (in_box(entry.first)) { func(entry); }
+            }
+        }
+        return;
+    }
+
+    for (int y = low.y; y <= high.y; ++y) {
+        for (int x = low.x; x <= high.x; ++x) {
+            auto cell = grid.find({x, y});
+            if (cell == grid.end()) {
+                continue;
+            }
+            for (const auto& entry : cell->second) {
+                if (in_box(entry.first)) { func(entry); }
+            }
+        }
+    }
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_nearest(Coord xy, unsigned int k)
+{
+    COUNT_CALL(GET_AFFILIATIONS_NEAREST);
+    TRACE_SCOPE("get_affiliations_nearest");
+    std::vector<AffiliationID> nearest;
+    if (k == 0 || grid.empty()) {
+        return nearest;
+    }
+
+    // Max-heap of the k closest affiliations found so far, the farthest of them at the top
+    std::vector<SpatialCandidate> heap;
+    auto consider = [&heap, &xy, k] (const std::pair<Coord, AffiliationID>& entry) {
+        SpatialCandidate candidate{squared_distance(entry.first, xy), entry.first, &entry.second};
+        if (heap.size() < k) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), closer);
+        } else if (closer(candidate, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), closer);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), closer);
+        }
+    };
+
+    // Rings of cells around the cell of xy, ring r being the cells r cells away in x or y.
+    // Rings that don't reach the bounding box or are completely outside it are skipped.
+    Coord center = grid_cell(xy);
+    Coord low = grid_cell(gridMinCoord);
+    Coord high = grid_cell(gridMaxCoord);
+    long long firstRing = std::max({0LL, static_cast<long long>(low.x) - center.x, static_cast<long long>(center.x) - high.x,
+                                    static_cast<long long>(low.y) - center.y, static_cast<long long>(center.y) - high.y});
+    long long lastRing = std::max({static_cast<long long>(center.x) - low.x, static_cast<long long>(high.x) - center.x,
+                                   static_cast<long long>(center.y) - low.y, static_cast<long long>(high.y) - center.y});
+
+    std::size_t cellsVisited = 0;
+    auto visit_cell = [this, &consider, &cellsVisited] (long long x, long long y) {
+        ++cellsVisited;
+        auto cell = grid.find({static_cast<int>(x), static_cast<int>(y)});
+        if (cell != grid.end()) {
+            for (const auto& entry : cell->second) { consider(entry); }
+        }
+    };
+
+    for (long long ring = firstRing; ring <= lastRing; ++ring) {
+        // Every affiliation in this ring or farther is more than ring-1 cells away from xy
+        if (heap.size() == k && ring > 0) {
+            double bound = static_cast<double>(ring - 1) * gridCellSize;
+            if (bound * bound >= heap.front().distance) {
+                break;
+            }
+        }
+
+        // Sparse grid, going through all the nonempty cells is faster than looking up more empty ones
+        if (cellsVisited > grid.size()) {
+            heap.clear();
+            for (const auto& cell : grid) {
+                for (const auto& entry : cell.second) { consider(entry); }
+            }
+            break;
+        }
+
+        // Top and bottom rows of the ring, then the left and right columns without the corners
+        for (long long y : {center.y - ring, center.y + ring}) {
+            if (y >= low.y && y <= high.y) {
+                for (long long x = std::max<long long>(center.x - ring, low.x); x <= std::min<long long>(center.x + ring, high.x); ++x) {
+                    visit_cell(x, y);
+                }
+            }
+            if (ring == 0) { break; }
+        }
+        for (long long x : {center.x - ring, center.x + ring}) {
+            if (ring == 0) { break; }
+            if (x >= low.x && x <= high.x) {
+                for (long long y = std::max<long long>(center.y - ring + 1, low.y); y <= std::min<long long>(center.y + ring - 1, high.y); ++y) {
+                    visit_cell(x, y);
+                }
+            }
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), closer);
+    nearest.reserve(heap.size());
+    for (const auto& candidate : heap) {
+        nearest.push_back(*candidate.id);
+    }
+    COUNT_ADD(elementsCopied, nearest.size());
+    return nearest;
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_within(Coord xy, Distance radius)
+{
+    COUNT_CALL(GET_AFFILIATIONS_WITHIN);
+    TRACE_SCOPE("get_affiliations_within");
+    std::vector<AffiliationID> within;
+    if (radius < 0) {
+        return within;
+    }
+
+    // Only the affiliations in the bounding box of the circle need their distance checked
+    auto clamp = [] (long long value) {
+        return static_cast<int>(std::max<long long>(std::numeric_limits<int>::min() + 1LL,
+                                                    std::min<long long>(std::numeric_limits<int>::max(), value)));
+    };
+    Coord min = {clamp(static_cast<long long>(xy.x) - radius), clamp(static_cast<long long>(xy.y) - radius)};
+    Coord max = {clamp(static_cast<long long>(xy.x) + radius), clamp(static_cast<long long>(xy.y) + radius)};
+    double limit = static_cast<double>(radius) * radius;
+
+    std::vector<SpatialCandidate> found;
+    grid_for_each_in_box(min, max, [&found, &xy, limit] (const std::pair<Coord, AffiliationID>& entry) {
+        double distance = squared_distance(entry.first, xy);
+        if (distance <= limit) {
+            found.push_back({distance, entry.first, &entry.second});
+        }
+    });
+
+    std::sort(found.begin(), found.end(), closer);
+    within.reserve(found.size());
+    for (const auto& candidate : found) {
+        within.push_back(*candidate.id);
+    }
+    COUNT_ADD(elementsCopied, within.size());
+    return within;
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_in_box(Coord min, Coord max)
+{
+    COUNT_CALL(GET_AFFILIATIONS_IN_BOX);
+    TRACE_SCOPE("get_affiliations_in_box");
+    // Any two opposite corners define the box
+    Coord low = {std::min(min.x, max.x), std::min(min.y, max.y)};
+    Coord high = {std::max(min.x, max.x), std::max(min.y, max.y)};
+
+    // Returned in the order of the grid cells, sorting them would make the query O(c + m log(m))
+    std::vector<AffiliationID> inBox;
+    grid_for_each_in_box(low, high, [&inBox] (const std::pair<Coord, AffiliationID>& entry) {
+        inBox.push_back(entry.second);
+    });
+    COUNT_ADD(elementsCopied, inBox.size());
+    return inBox;
+}
+
+AffiliationChanges Datastructures::get_affiliation_changes(unsigned long long since)
+{
+    COUNT_CALL(GET_AFFILIATION_CHANGES);
+    TRACE_SCOPE("get_affiliation_changes");
+    AffiliationChanges changes;
+    changes.version = changeLogStart + changeLog.size();
+    // Changes before the start of the log are lost, and a version from the future can't be trusted either
+    changes.complete = since >= changeLogStart && since <= changes.version;
+    if (changes.complete) {
+        changes.changed.assign(changeLog.begin() + (since - changeLogStart), changeLog.end());
+        COUNT_ADD(elementsCopied, changes.changed.size());
     }
+    return changes;
 }
 
+std::pair<Coord, Coord> Datastructures::get_affiliation_bounds()
+{
+    COUNT_CALL(GET_AFFILIATION_BOUNDS);
+    TRACE_SCOPE("get_affiliation_bounds");
+    if (grid.empty()) {
+        return {NO_COORD, NO_COORD};
+    }
+    return {gridMinCoord, gridMaxCoord};
+}
 
+void Datastructures::log_change(const AffiliationID &id)
+{
+    // Dropping the older half keeps the log bounded and the trimming O(1) amortized
+    if (changeLog.size() >= CHANGE_LOG_LIMIT) {
+        std::size_t dropped = changeLog.size() / 2;
+        changeLog.erase(changeLog.begin(), changeLog.begin() + dropped);
+        changeLogStart += dropped;
+    }
+    changeLog.push_back(id);
+}
+
+std::vector<std::pair<AffiliationID, Weight>> Datastructures::get_collaborators(AffiliationID id)
+{
+    COUNT_CALL(GET_COLLABORATORS);
+    TRACE_SCOPE("get_collaborators");
+    auto it = affiliations.find(id);
+    COUNT_LOOKUP(it != affiliations.end());
+    if (it == affiliations.end()) {
+        return {{NO_AFFILIATION, NO_WEIGHT}};
+    }
+
+    // Most shared publications first, equal weights in the order of the IDs
+    std::vector<std::pair<AffiliationID, Weight>> collaborators;
+    collaborators.reserve(it->second.collaborators.size());
+    for (const auto& collaborator : it->second.collaborators) {
+        collaborators.push_back({collaborator.first->first, collaborator.second});
+    }
+    std::sort(collaborators.begin(), collaborators.end(), [] (const auto& collaborator1, const auto& collaborator2) {
+        if (collaborator1.second != collaborator2.second) { return collaborator1.second > collaborator2.second; }
+        return collaborator1.first < collaborator2.first;
+    });
+    COUNT_ADD(elementsCopied, collaborators.size());
+    return collaborators;
+}
+
+void Datastructures::change_collaborations(const AffiliationID &id, std::vector<AffiliationID>::const_iterator begin,
+                                           std::vector<AffiliationID>::const_iterator end, Weight change)
+{
+    // Only the existing affiliations have collaborators
+    auto affiliation = affiliations.find(id);
+    if (affiliation == affiliations.end()) {
+        return;
+    }
+    for (auto other = begin; other != end; ++other) {
+        // An affiliation listed more than once collaborates only once
+        if (*other == id || std::find(begin, other, *other) != other) {
+            continue;
+        }
+        auto collaborator = affiliations.find(*other);
+        if (collaborator == affiliations.end()) {
+            continue;
+        }
+        auto forward = find_collaborator(&*affiliation, &*collaborator);
+        auto backward = find_collaborator(&*collaborator, &*affiliation);
+        Weight weight = forward->second + change;
+        if (weight > 0) {
+            forward->second = weight;
+            backward->second = weight;
+        } else {
+            affiliation->second.collaborators.erase(forward);
+            collaborator->second.collaborators.erase(backward);
+        }
+    }
+}
+
+std::vector<std::pair<Datastructures::AffiliationEntry*, Weight>>::iterator
+Datastructures::find_collaborator(AffiliationEntry *affiliation, AffiliationEntry *collaborator)
+{
+    auto& collaborators = affiliation->second.collaborators;
+    auto it = std::lower_bound(collaborators.begin(), collaborators.end(), collaborator,
+                               [] (const auto& entry, const AffiliationEntry* other) { return entry.first < other; });
+    if (it == collaborators.end() || it->first != collaborator) {
+        it = collaborators.insert(it, {collaborator, 0});
+    }
+    return it;
+}
+
+void Datastructures::change_collaborations(const std::vector<AffiliationID> &affiliationsOfPub, Weight change)
+{
+    // Each affiliation is paired with the ones before its first listing
+    for (auto it = affiliationsOfPub.begin(); it != affiliationsOfPub.end(); ++it) {
+        if (std::find(affiliationsOfPub.begin(), it, *it) == it) {
+            change_collaborations(*it, affiliationsOfPub.begin(), it, change);
+        }
+    }
+}
+
+std::vector<AffiliationID> Datastructures::get_collaboration_path(AffiliationID source, AffiliationID target)
+{
+    COUNT_CALL(GET_COLLABORATION_PATH);
+    TRACE_SCOPE("get_collaboration_path");
+    auto sourceIt = affiliations.find(source);
+    auto targetIt = affiliations.find(target);
+    COUNT_LOOKUP(sourceIt != affiliations.end());
+    COUNT_LOOKUP(targetIt != affiliations.end());
+    if (sourceIt == affiliations.end() || targetIt == affiliations.end()) {
+        return {NO_AFFILIATION};
+    }
+    if (source == target) {
+        return {source};
+    }
+
+    start_search();
+    sourceIt->second.search[0] = {searchEpoch, 0, nullptr};
+    targetIt->second.search[1] = {searchEpoch, 0, nullptr};
+    searchFrontier[0].push_back(&*sourceIt);
+    searchFrontier[1].push_back(&*targetIt);
+
+    // The edge where the searches meet, its end reached by the forward search and the one reached by the backward search
+    AffiliationEntry* forwardEnd = nullptr;
+    AffiliationEntry* backwardEnd = nullptr;
+    double shortest = std::numeric_limits<double>::infinity();
+
+    // One level at a time, the shortest path is found on the first level where the searches meet
+    while (!forwardEnd && !searchFrontier[0].empty() && !searchFrontier[1].empty()) {
+        int side = searchFrontier[0].size() <= searchFrontier[1].size() ? 0 : 1;
+        searchNext.clear();
+        for (AffiliationEntry* entry : searchFrontier[side]) {
+            const SearchState& state = entry->second.search[side];
+            for (const auto& collaborator : entry->second.collaborators) {
+                AffiliationEntry* next = collaborator.first;
+                SearchState& nextState = next->second.search[side];
+                const SearchState& otherState = next->second.search[1 - side];
+                if (otherState.epoch == searchEpoch && state.distance + 1 + otherState.distance < shortest) {
+                    shortest = state.distance + 1 + otherState.distance;
+                    forwardEnd = side == 0 ? entry : next;
+                    backwardEnd = side == 0 ? next : entry;
+                }
+                if (nextState.epoch != searchEpoch) {
+                    nextState = {searchEpoch, state.distance + 1, entry};
+                    searchNext.push_back(next);
+                }
+            }
+        }
+        std::swap(searchFrontier[side], searchNext);
+    }
+
+    if (!forwardEnd) {
+        return {};
+    }
+    return search_path(forwardEnd, backwardEnd);
+}
+
+std::vector<AffiliationID> Datastructures::get_collaboration_path_by_distance(AffiliationID source, AffiliationID target)
+{
+    COUNT_CALL(GET_COLLABORATION_PATH_BY_DISTANCE);
+    TRACE_SCOPE("get_collaboration_path_by_distance");
+    auto sourceIt = affiliations.find(source);
+    auto targetIt = affiliations.find(target);
+    COUNT_LOOKUP(sourceIt != affiliations.end());
+    COUNT_LOOKUP(targetIt != affiliations.end());
+    if (sourceIt == affiliations.end() || targetIt == affiliations.end()) {
+        return {NO_AFFILIATION};
+    }
+    if (source == target) {
+        return {source};
+    }
+
+    // Min-heaps by distance, outdated entries are skipped when popped
+    auto further = [] (const std::pair<double, AffiliationEntry*>& entry1, const std::pair<double, AffiliationEntry*>& entry2) {
+        return entry1.first > entry2.first;
+    };
+
+    start_search();
+    sourceIt->second.search[0] = {searchEpoch, 0, nullptr};
+    targetIt->second.search[1] = {searchEpoch, 0, nullptr};
+    searchHeap[0].push_back({0, &*sourceIt});
+    searchHeap[1].push_back({0, &*targetIt});
+
+    AffiliationEntry* forwardEnd = nullptr;
+    AffiliationEntry* backwardEnd = nullptr;
+    double shortest = std::numeric_limits<double>::infinity();
+
+    // The path can't get shorter once the closest unsettled affiliations of the two searches are together at least as far
+    while (!searchHeap[0].empty() && !searchHeap[1].empty()
+           && searchHeap[0].front().first + searchHeap[1].front().first < shortest) {
+        int side = searchHeap[0].front().first <= searchHeap[1].front().first ? 0 : 1;
+        auto& heap = searchHeap[side];
+        std::pop_heap(heap.begin(), heap.end(), further);
+        auto [distance, entry] = heap.back();
+        heap.pop_back();
+        if (distance > entry->second.search[side].distance) {
+            continue;
+        }
+
+        for (const auto& collaborator : entry->second.collaborators) {
+            AffiliationEntry* next = collaborator.first;
+            double nextDistance = distance + std::sqrt(squared_distance(entry->second.coordinates, next->second.coordinates));
+            SearchState& nextState = next->second.search[side];
+            if (nextState.epoch != searchEpoch || nextDistance < nextState.distance) {
+                nextState = {searchEpoch, nextDistance, entry};
+                heap.push_back({nextDistance, next});
+                std::push_heap(heap.begin(), heap.end(), further);
+            }
+            const SearchState& otherState = next->second.search[1 - side];
+            if (otherState.epoch == searchEpoch && nextDistance + otherState.distance < shortest) {
+                shortest = nextDistance + otherState.distance;
+                forwardEnd = side == 0 ? entry : next;
+                backwardEnd = side == 0 ? next : entry;
+            }
+        }
+    }
+
+    if (!forwardEnd) {
+        return {};
+    }
+    return search_path(forwardEnd, backwardEnd);
+}
+
+void Datastructures::start_search()
+{
+    // Starting a new epoch invalidates the states of the previous search, they are
+    // reset only when the epoch counter wraps around
+    if (++searchEpoch == 0) {
+        for (auto& affiliation : affiliations) {
+            affiliation.second.search[0] = {};
+            affiliation.second.search[1] = {};
+        }
+        searchEpoch = 1;
+    }
+    for (int side = 0; side < 2; ++side) {
+        searchFrontier[side].clear();
+        searchHeap[side].clear();
+    }
+}
+
+std::vector<AffiliationID> Datastructures::search_path(AffiliationEntry* forwardEnd, AffiliationEntry* backwardEnd)
+{
+    // From the meeting point back to the source, then reversed
+    std::vector<AffiliationID> path;
+    for (AffiliationEntry* entry = forwardEnd; entry; entry = entry->second.search[0].previous) {
+        path.push_back(entry->first);
+    }
+    std::reverse(path.begin(), path.end());
+    // And on from the meeting point to the target
+    for (AffiliationEntry* entry = backwardEnd; entry; entry = entry->second.search[1].previous) {
+        path.push_back(entry->first);
+    }
+    COUNT_ADD(elementsCopied, path.size());
+    return path;
+}
+
+int Datastructures::get_citation_count(PublicationID id)
+{
+    COUNT_CALL(GET_CITATION_COUNT);
+    TRACE_SCOPE("get_citation_count");
+    auto it = publications.find(id);
+    COUNT_LOOKUP(it != publications.end());
+    if (it != publications.end()) {
+        count_citations();
+        return it->second.citations;
+    }
+    return NO_VALUE;
+}
+
+std::vector<PublicationID> Datastructures::get_most_cited(unsigned int k)
+{
+    COUNT_CALL(GET_MOST_CITED);
+    TRACE_SCOPE("get_most_cited");
+    count_citations();
+    std::vector<PublicationID> topK;
+    topK.reserve(std::min<std::size_t>(k, mostCited.size()));
+    for (auto it = mostCited.begin(); it != mostCited.end() && topK.size() < k; ++it) {
+        topK.push_back(it->second);
+    }
+    COUNT_ADD(elementsCopied, topK.size());
+    return topK;
+}
+
+void Datastructures::count_citations()
+{
+    if (citationsCounted) {
+        return;
+    }
+    ++citationRound;
+
+    // The citations of a publication are its children and their citations. The children are counted first
+    // with an explicit stack, so that long reference chains cannot overflow the call stack.
+    // The publications are visited in the order they were added, so that the same reference is left out of
+    // every cycle each time.
+    std::vector<std::pair<Publication*, std::size_t>> stack;
+    for (const auto& id : publicationVec) {
+        Publication* publication = &publications.at(id);
+        if (publication->citationRound == citationRound) {
+            continue;
+        }
+        publication->citations = 0;
+        publication->citationsOnPath = true;
+        stack.push_back({publication, 0});
+        while (!stack.empty()) {
+            Publication* current = stack.back().first;
+            std::size_t next = stack.back().second++;
+            COUNT_ADD(chainSteps, 1);
+            if (next < current->children.size()) {
+                Publication* child = current->children[next].second;
+                if (child->citationRound == citationRound) {
+                    current->citations += child->citations + 1;
+                } else if (!child->citationsOnPath) {
+                    child->citations = 0;
+                    child->citationsOnPath = true;
+                    stack.push_back({child, 0});
+                }
+                // A child already on the path closes a cycle and isn't counted
+                continue;
+            }
+            current->citationsOnPath = false;
+            current->citationRound = citationRound;
+            stack.pop_back();
+            if (!stack.empty()) {
+                stack.back().first->citations += current->citations + 1;
+            }
+        }
+    }
+
+    // The sorted entries are inserted at the end of the set in O(1) each
+    std::vector<std::pair<unsigned int, PublicationID>> counts;
+    counts.reserve(publications.size());
+    for (const auto& publication : publications) {
+        counts.push_back({publication.second.citations, publication.first});
+    }
+    std::sort(counts.begin(), counts.end(), MoreCited());
+    mostCited.clear();
+    for (const auto& count : counts) {
+        mostCited.insert(mostCited.end(), count);
+    }
+    citationsCounted = true;
+    COUNT_ADD(sortedRebuilds, 1);
+}
+
+std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_between(Year first, Year last)
+{
+    COUNT_CALL(GET_PUBLICATIONS_BETWEEN);
+    TRACE_SCOPE("get_publications_between");
+    std::vector<std::pair<Year, PublicationID>> between;
+    if (yearBuckets.empty() || first > last) {
+        return between;
+    }
+
+    between.reserve(count_publications_between(first, last));
+    for (unsigned int year = first; year <= last; ++year) {
+        for (const auto& id : yearBuckets[year]) {
+            between.push_back({static_cast<Year>(year), id});
+        }
+    }
+    COUNT_ADD(elementsCopied, between.size());
+    return between;
+}
+
+unsigned int Datastructures::count_publications_between(Year first, Year last)
+{
+    COUNT_CALL(COUNT_PUBLICATIONS_BETWEEN);
+    TRACE_SCOPE("count_publications_between");
+    if (yearCounts.empty() || first > last) {
+        return 0;
+    }
+    return year_count_before(static_cast<unsigned int>(last) + 1) - year_count_before(first);
+}
+
+std::vector<std::pair<Year, unsigned int>> Datastructures::get_publication_counts_by_year(Year first, Year last)
+{
+    COUNT_CALL(GET_PUBLICATION_COUNTS_BY_YEAR);
+    TRACE_SCOPE("get_publication_counts_by_year");
+    std::vector<std::pair<Year, unsigned int>> counts;
+    if (yearBuckets.empty()) {
+        return counts;
+    }
+
+    for (unsigned int year = first; year <= last; ++year) {
+        if (!yearBuckets[year].empty()) {
+            counts.push_back({static_cast<Year>(year), yearBuckets[year].size()});
+        }
+    }
+    COUNT_ADD(elementsCopied, counts.size());
+    return counts;
+}
+
+void Datastructures::year_index_insert(PublicationID id, Year year)
+{
+    // Every possible year has a bucket, so a query never has to check the range
+    if (yearBuckets.empty()) {
+        yearBuckets.resize(std::numeric_limits<Year>::max() + 1);
+        yearCounts.assign(std::numeric_limits<Year>::max() + 2, 0);
+    }
+    yearBuckets[year].push_back(id);
+
+    // Fenwick tree indices start from 1
+    for (unsigned int i = year + 1; i < yearCounts.size(); i += i & -i) {
+        ++yearCounts[i];
+    }
+}
+
+void Datastructures::year_index_erase(PublicationID id, Year year)
+{
+    if (yearBuckets.empty()) {
+        return;
+    }
+    auto& bucket = yearBuckets[year];
+    auto it = std::find(bucket.begin(), bucket.end(), id);
+    if (it == bucket.end()) {
+        return;
+    }
+    // Order inside a bucket doesn't matter, so the last publication can be moved in its place
+    *it = bucket.back();
+    bucket.pop_back();
+
+    for (unsigned int i = year + 1; i < yearCounts.size(); i += i & -i) {
+        --yearCounts[i];
+    }
+}
+
+unsigned int Datastructures::year_count_before(unsigned int year) const
+{
+    unsigned int count = 0;
+    for (unsigned int i = year; i > 0; i -= i & -i) {
+        count += yearCounts[i];
+    }
+    return count;
+}
+
+std::vector<AffiliationID> Datastructures::find_affiliations_by_prefix(const Name &prefix, unsigned int limit)
+{
+    COUNT_CALL(FIND_AFFILIATIONS_BY_PREFIX);
+    TRACE_SCOPE("find_affiliations_by_prefix");
+    sort_alphabetically();
+
+    std::string_view chars = nameTableChars;
+    auto name = [this, chars] (std::size_t i) {
+        return chars.substr(nameTableOffsets[i], nameTableOffsets[i + 1] - nameTableOffsets[i]);
+    };
+
+    // The names starting with the prefix are together, starting from the first name that isn't less than the prefix
+    std::size_t low = 0;
+    std::size_t high = affilIDVecAlph.size();
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        if (name(middle) < prefix) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    std::vector<AffiliationID> found;
+    for (std::size_t i = low; i < affilIDVecAlph.size() && found.size() < limit; ++i) {
+        if (name(i).substr(0, prefix.size()) != prefix) {
+            break;
+        }
+        found.push_back(affilIDVecAlph[i]);
+    }
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+std::vector<PublicationID> Datastructures::search_publications(const std::string &terms)
+{
+    COUNT_CALL(SEARCH_PUBLICATIONS);
+    TRACE_SCOPE("search_publications");
+    std::vector<PostingList*> lists;
+    for (const auto& word : title_words(terms)) {
+        auto it = titleIndex.find(word);
+        COUNT_LOOKUP(it != titleIndex.end());
+        // No publication has all the words if one of them is in no title
+        if (it == titleIndex.end()) {
+            return {};
+        }
+        lists.push_back(&it->second);
+    }
+    std::vector<PublicationID> found = posting_intersection(lists);
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+void Datastructures::title_index_insert(PublicationID id, const Name &heading)
+{
+    for (auto& word : title_words(heading)) {
+        posting_insert(titleIndex[std::move(word)], id);
+    }
+}
+
+void Datastructures::title_index_erase(PublicationID id, const Name &heading)
+{
+    for (const auto& word : title_words(heading)) {
+        auto term = titleIndex.find(word);
+        if (term == titleIndex.end()) {
+            continue;
+        }
+        posting_erase(term->second, id);
+        if (term->second.size == 0) {
+            titleIndex.erase(term);
+        }
+    }
+}
+
+std::vector<AffiliationID> Datastructures::find_similar_affiliations(const Name &name, unsigned int k)
+{
+    COUNT_CALL(FIND_SIMILAR_AFFILIATIONS);
+    TRACE_SCOPE("find_similar_affiliations");
+    if (name.empty() || k == 0) {
+        return {};
+    }
+
+    // The lists of the frequent trigrams are skipped when the name has other trigrams too
+    auto trigrams = name_trigrams(name);
+    std::size_t frequent = std::max(std::size_t{FREQUENT_TRIGRAM_MIN}, affiliations.size() / FREQUENT_TRIGRAM_DIVISOR);
+    std::vector<std::vector<AffiliationEntry*> const*> lists;
+    bool skipped = false;
+    for (unsigned int trigram : trigrams) {
+        auto it = trigramIndex.find(trigram);
+        COUNT_LOOKUP(it != trigramIndex.end());
+        if (it == trigramIndex.end()) {
+            continue;
+        }
+        if (it->second.size() > frequent) {
+            skipped = true;
+        } else {
+            lists.push_back(&it->second);
+        }
+    }
+    if (lists.empty() && skipped) {
+        skipped = false;
+        for (unsigned int trigram : trigrams) {
+            auto it = trigramIndex.find(trigram);
+            if (it != trigramIndex.end()) {
+                lists.push_back(&it->second);
+            }
+        }
+    }
+
+    // Counting the shared trigrams of every affiliation that has at least one of them,
+    // the others have similarity zero and are never visited
+    std::vector<AffiliationEntry*> candidates;
+    for (const auto list : lists) {
+        COUNT_ADD(chainSteps, list->size());
+        for (AffiliationEntry* affiliation : *list) {
+            if (affiliation->second.sharedTrigrams++ == 0) {
+                candidates.push_back(affiliation);
+            }
+        }
+    }
+
+    // The candidates may share skipped trigrams too, so their shared trigrams are counted again from the names
+    if (skipped) {
+        for (AffiliationEntry* affiliation : candidates) {
+            auto own = name_trigrams(affiliation->second.name);
+            unsigned int shared = 0;
+            for (auto it1 = trigrams.begin(), it2 = own.begin(); it1 != trigrams.end() && it2 != own.end();) {
+                if (*it1 < *it2) {
+                    ++it1;
+                } else if (*it2 < *it1) {
+                    ++it2;
+                } else {
+                    ++shared, ++it1, ++it2;
+                }
+            }
+            affiliation->second.sharedTrigrams = shared;
+        }
+    }
+
+    // Jaccard similarity of the trigram sets, the counts are reset for the next search
+    std::vector<std::pair<double, AffiliationEntry*>> scored;
+    scored.reserve(candidates.size());
+    for (AffiliationEntry* affiliation : candidates) {
+        double shared = affiliation->second.sharedTrigrams;
+        scored.push_back({shared / (trigrams.size() + affiliation->second.trigramCount - shared), affiliation});
+        affiliation->second.sharedTrigrams = 0;
+    }
+
+    auto more_similar = [] (const auto& candidate1, const auto& candidate2) {
+        if (candidate1.first != candidate2.first) { return candidate1.first > candidate2.first; }
+        return candidate1.second->first < candidate2.second->first;
+    };
+    auto last = scored.begin() + std::min<std::size_t>(k, scored.size());
+    std::partial_sort(scored.begin(), last, scored.end(), more_similar);
+
+    std::vector<AffiliationID> found;
+    for (auto it = scored.begin(); it != last; ++it) {
+        found.push_back(it->second->first);
+    }
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+void Datastructures::trigram_index_insert(AffiliationEntry *affiliation)
+{
+    auto trigrams = name_trigrams(affiliation->second.name);
+    affiliation->second.trigramCount = trigrams.size();
+    for (unsigned int trigram : trigrams) {
+        trigramIndex[trigram].push_back(affiliation);
+    }
+}
+
+void Datastructures::trigram_index_erase(AffiliationEntry *affiliation)
+{
+    for (unsigned int trigram : name_trigrams(affiliation->second.name)) {
+        auto it = trigramIndex.find(trigram);
+        if (it == trigramIndex.end()) {
+            continue;
+        }
+        // The order of the list doesn't matter, so the last affiliation is moved in place of the removed one
+        auto& list = it->second;
+        auto position = std::find(list.begin(), list.end(), affiliation);
+        if (position != list.end()) {
+            *position = list.back();
+            list.pop_back();
+        }
+        if (list.empty()) {
+            trigramIndex.erase(it);
+        }
+    }
+}
+
+std::vector<PublicationID> Datastructures::get_common_publications(AffiliationID id1, AffiliationID id2)
+{
+    COUNT_CALL(GET_COMMON_PUBLICATIONS);
+    TRACE_SCOPE("get_common_publications");
+    auto it1 = affiliations.find(id1);
+    auto it2 = affiliations.find(id2);
+    COUNT_LOOKUP(it1 != affiliations.end());
+    COUNT_LOOKUP(it2 != affiliations.end());
+    if (it1 == affiliations.end() || it2 == affiliations.end()) {
+        return {NO_PUBLICATION};
+    }
+
+    std::vector<PostingList*> lists = {&it1->second.publicationList, &it2->second.publicationList};
+    std::vector<PublicationID> found = posting_intersection(lists);
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+std::vector<PublicationID> Datastructures::get_common_publications_of(const std::vector<AffiliationID> &ids)
+{
+    COUNT_CALL(GET_COMMON_PUBLICATIONS_OF);
+    TRACE_SCOPE("get_common_publications_of");
+    std::vector<PostingList*> lists;
+    for (const auto& id : ids) {
+        auto it = affiliations.find(id);
+        COUNT_LOOKUP(it != affiliations.end());
+        if (it == affiliations.end()) {
+            return {NO_PUBLICATION};
+        }
+        lists.push_back(&it->second.publicationList);
+    }
+
+    std::vector<PublicationID> found = posting_intersection(lists);
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+void Datastructures::posting_insert(PostingList &list, PublicationID id)
+{
+    auto& bytes = list.bytes;
+    ++list.size;
+    if (bytes.empty()) {
+        encode_posting_block(bytes, &id, &id + 1);
+        list.lastBlock = 0;
+        return;
+    }
+
+    // The ID goes to the first block ending at it or after it, IDs larger than all the others to the last block
+    std::size_t offset = list.lastBlock;
+    PostingBlock block = read_posting_block(bytes, offset);
+    if (id < block.last) {
+        for (offset = 0; ; offset = block.end) {
+            block = read_posting_block(bytes, offset);
+            if (block.last >= id) {
+                break;
+            }
+        }
+    }
+
+    std::vector<PublicationID> ids;
+    decode_posting_block(bytes, block, ids);
+    ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+
+    // A full block is split in two halves
+    std::vector<unsigned char> encoded;
+    std::size_t half = ids.size() > POSTING_BLOCK_SIZE ? ids.size() / 2 : ids.size();
+    encode_posting_block(encoded, ids.data(), ids.data() + half);
+    std::size_t secondHalf = encoded.size();
+    if (half < ids.size()) {
+        encode_posting_block(encoded, ids.data() + half, ids.data() + ids.size());
+    }
+
+    bool last = offset == list.lastBlock;
+    long long growth = static_cast<long long>(encoded.size()) - static_cast<long long>(block.end - offset);
+    bytes.erase(bytes.begin() + offset, bytes.begin() + block.end);
+    bytes.insert(bytes.begin() + offset, encoded.begin(), encoded.end());
+    if (last) {
+        list.lastBlock = half < ids.size() ? offset + secondHalf : offset;
+    } else {
+        list.lastBlock += growth;
+    }
+    COUNT_ADD(elementsCopied, ids.size());
+}
+
+void Datastructures::posting_erase(PostingList &list, PublicationID id)
+{
+    auto& bytes = list.bytes;
+    std::size_t offset = 0;
+    PostingBlock block = {0, 0, 0, 0};
+    for ( ; offset < bytes.size(); offset = block.end) {
+        block = read_posting_block(bytes, offset);
+        if (block.last >= id) {
+            break;
+        }
+    }
+    if (offset >= bytes.size() || block.first > id) {
+        return;
+    }
+
+    std::vector<PublicationID> ids;
+    decode_posting_block(bytes, block, ids);
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (*it != id) {
+        return;
+    }
+    ids.erase(it);
+    --list.size;
+
+    std::vector<unsigned char> encoded;
+    if (!ids.empty()) {
+        encode_posting_block(encoded, ids.data(), ids.data() + ids.size());
+    }
+    bool last = offset == list.lastBlock;
+    long long growth = static_cast<long long>(encoded.size()) - static_cast<long long>(block.end - offset);
+    bytes.erase(bytes.begin() + offset, bytes.begin() + block.end);
+    bytes.insert(bytes.begin() + offset, encoded.begin(), encoded.end());
+    COUNT_ADD(elementsCopied, ids.size());
+
+    if (!last) {
+        list.lastBlock += growth;
+    } else if (ids.empty()) {
+        // The removed block was the last one, the new last block is found from the start
+        list.lastBlock = 0;
+        for (std::size_t next = 0; next < bytes.size(); next = read_posting_block(bytes, next).end) {
+            list.lastBlock = next;
+        }
+    }
+}
+
+std::vector<PublicationID> Datastructures::posting_intersection(std::vector<PostingList*> &lists)
+{
+    if (lists.empty()) {
+        return {};
+    }
+
+    // Starting from the shortest list keeps the intermediate results as short as possible
+    std::sort(lists.begin(), lists.end(), [] (const PostingList* list1, const PostingList* list2) {
+        return list1->size < list2->size;
+    });
+    std::vector<PublicationID> found = decode_posting_list(lists.front()->bytes);
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    for (std::size_t i = 1; i < lists.size() && !found.empty(); ++i) {
+        intersect_posting_list(found, lists[i]->bytes);
+    }
+    return found;
+}
+
+std::vector<AffiliationID> Datastructures::existing_affiliations(const std::vector<AffiliationID> &affiliationsOfPub) const
+{
+    std::vector<AffiliationID> existing;
+    existing.reserve(affiliationsOfPub.size());
+    for (const auto& affiliationid : affiliationsOfPub) {
+        if (affiliations.find(affiliationid) != affiliations.end()) {
+            existing.push_back(affiliationid);
+        }
+    }
+    return existing;
+}
+
+void Datastructures::link_publication(PublicationID id, Year year, const std::vector<AffiliationID> &affiliationsOfPub)
+{
+    for (const auto& affiliationid : affiliationsOfPub) {
+        auto it = affiliations.find(affiliationid);
+        if (it != affiliations.end()) {
+            it->second.affiliatedPubs.push_back({id, year});
+            posting_insert(it->second.publicationList, id);
+            minhash_add(&*it, id);
+        }
+    }
+}
+
+void Datastructures::unlink_publication(PublicationID id, const std::vector<AffiliationID> &affiliationsOfPub)
+{
+    for (const auto& affiliationid : affiliationsOfPub) {
+        auto it = affiliations.find(affiliationid);
+        if (it != affiliations.end()) {
+            posting_erase(it->second.publicationList, id);
+            minhash_rebuild(&*it);
+        }
+    }
+}
+
+std::vector<AffiliationID> Datastructures::get_similar_affiliations(AffiliationID id, unsigned int k)
+{
+    COUNT_CALL(GET_SIMILAR_AFFILIATIONS);
+    TRACE_SCOPE("get_similar_affiliations");
+    auto it = affiliations.find(id);
+    COUNT_LOOKUP(it != affiliations.end());
+    if (it == affiliations.end()) {
+        return {NO_AFFILIATION};
+    }
+    if (!it->second.hashed || k == 0) {
+        return {};
+    }
+
+    lsh_update();
+
+    // Candidates are the other affiliations in the buckets of the affiliation's bands
+    std::vector<AffiliationEntry*> candidates;
+    const MinHashSignature& signature = it->second.signature;
+    auto by_key = [] (const auto& entry, unsigned long long key) { return entry.first < key; };
+    for (std::size_t band = 0; band < MINHASH_SIZE / LSH_ROWS; ++band) {
+        unsigned long long key = lsh_key(band, &signature[band * LSH_ROWS], LSH_ROWS);
+        auto entry = std::lower_bound(lshBuckets.begin(), lshBuckets.end(), key, by_key);
+        for (; entry != lshBuckets.end() && entry->first == key; ++entry) {
+            COUNT_ADD(chainSteps, 1);
+            if (entry->second != &*it) {
+                candidates.push_back(entry->second);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // The fraction of equal signature values estimates the Jaccard similarity
+    std::vector<std::pair<unsigned int, AffiliationEntry*>> scored;
+    scored.reserve(candidates.size());
+    for (AffiliationEntry* candidate : candidates) {
+        unsigned int equal = 0;
+        for (std::size_t i = 0; i < MINHASH_SIZE; ++i) {
+            equal += signature[i] == candidate->second.signature[i];
+        }
+        scored.push_back({equal, candidate});
+    }
+
+    auto more_similar = [] (const auto& candidate1, const auto& candidate2) {
+        if (candidate1.first != candidate2.first) { return candidate1.first > candidate2.first; }
+        return candidate1.second->first < candidate2.second->first;
+    };
+    auto last = scored.begin() + std::min<std::size_t>(k, scored.size());
+    std::partial_sort(scored.begin(), last, scored.end(), more_similar);
+
+    std::vector<AffiliationID> found;
+    for (auto candidate = scored.begin(); candidate != last; ++candidate) {
+        found.push_back(candidate->second->first);
+    }
+    COUNT_ADD(elementsCopied, found.size());
+    return found;
+}
+
+void Datastructures::minhash_add(AffiliationEntry *affiliation, PublicationID id)
+{
+    // The first publication replaces the empty signature
+    Affiliation& data = affiliation->second;
+    auto hashes = minhashes<MINHASH_SIZE>(id);
+    bool changed = !data.hashed;
+    for (std::size_t i = 0; i < MINHASH_SIZE; ++i) {
+        changed = changed || hashes[i] < data.signature[i];
+    }
+    if (!changed) {
+        return;
+    }
+    lsh_mark_pending(affiliation);
+    for (std::size_t i = 0; i < MINHASH_SIZE; ++i) {
+        if (!data.hashed || hashes[i] < data.signature[i]) {
+            data.signature[i] = hashes[i];
+        }
+    }
+    data.hashed = true;
+}
+
+void Datastructures::minhash_rebuild(AffiliationEntry *affiliation)
+{
+    Affiliation& data = affiliation->second;
+    auto ids = decode_posting_list(data.publicationList.bytes);
+    MinHashSignature signature;
+    signature.fill(std::numeric_limits<unsigned int>::max());
+    for (PublicationID id : ids) {
+        auto hashes = minhashes<MINHASH_SIZE>(id);
+        for (std::size_t i = 0; i < MINHASH_SIZE; ++i) {
+            signature[i] = std::min(signature[i], hashes[i]);
+        }
+    }
+    bool hashed = !ids.empty();
+    if (hashed == data.hashed && (!hashed || signature == data.signature)) {
+        return;
+    }
+    lsh_mark_pending(affiliation);
+    data.signature = signature;
+    data.hashed = hashed;
+}
+
+void Datastructures::lsh_mark_pending(AffiliationEntry *affiliation)
+{
+    Affiliation& data = affiliation->second;
+    if (data.lshPending != NOT_PENDING) {
+        return;
+    }
+    // An affiliation not yet pending has the entries of its current signature in the buckets
+    if (data.hashed) {
+        lshStale.push_back(affiliation);
+    }
+    data.lshPending = lshPending.size();
+    lshPending.push_back(affiliation);
+}
+
+void Datastructures::lsh_remove(AffiliationEntry *affiliation)
+{
+    lsh_mark_pending(affiliation);
+    // The order of the pending affiliations doesn't matter, so the last one is moved in place of the removed one
+    std::size_t index = affiliation->second.lshPending;
+    lshPending[index] = lshPending.back();
+    lshPending[index]->second.lshPending = index;
+    lshPending.pop_back();
+    affiliation->second.lshPending = NOT_PENDING;
+}
+
+void Datastructures::lsh_update()
+{
+    if (lshPending.empty() && lshStale.empty()) {
+        return;
+    }
+    std::sort(lshStale.begin(), lshStale.end());
+    auto stale = [this] (const auto& entry) {
+        return std::binary_search(lshStale.begin(), lshStale.end(), entry.second);
+    };
+    lshBuckets.erase(std::remove_if(lshBuckets.begin(), lshBuckets.end(), stale), lshBuckets.end());
+    lshStale.clear();
+
+    // The new entries are sorted separately and merged with the rest
+    std::size_t kept = lshBuckets.size();
+    for (AffiliationEntry* affiliation : lshPending) {
+        Affiliation& data = affiliation->second;
+        data.lshPending = NOT_PENDING;
+        if (!data.hashed) {
+            continue;
+        }
+        for (std::size_t band = 0; band < MINHASH_SIZE / LSH_ROWS; ++band) {
+            lshBuckets.push_back({lsh_key(band, &data.signature[band * LSH_ROWS], LSH_ROWS), affiliation});
+        }
+    }
+    lshPending.clear();
+    std::sort(lshBuckets.begin() + kept, lshBuckets.end());
+    std::inplace_merge(lshBuckets.begin(), lshBuckets.begin() + kept, lshBuckets.end());
+}
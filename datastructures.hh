@@ -12,7 +12,14 @@
 #include <functional>
 #include <exception>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <cmath>
+#include <array>
+
+#ifdef USE_OP_STATS
+#include <atomic>
+#endif
 
 // Types for IDs
 using AffiliationID = std::string;
@@ -92,6 +99,66 @@ private:
     std::string msg_;
 };
 
+// Types for adding many affiliations and publications at once
+struct AffiliationData
+{
+    AffiliationID id = NO_AFFILIATION;
+    Name name = NO_NAME;
+    Coord xy = NO_COORD;
+};
+
+struct PublicationData
+{
+    PublicationID id = NO_PUBLICATION;
+    Name name = NO_NAME;
+    Year year = NO_YEAR;
+    std::vector<AffiliationID> affiliations = {};
+    // The publication this one references, NO_PUBLICATION if none
+    PublicationID parent = NO_PUBLICATION;
+};
+
+// Type for reporting the estimated memory footprint of the data structures
+struct MemoryUsage
+{
+    // Bytes held by each container, in the order they should be reported
+    std::vector<std::pair<std::string, std::size_t>> containers = {};
+    // Load factors of the hash tables
+    std::vector<std::pair<std::string, double>> loadFactors = {};
+    // Bytes allocated for vector capacity that is not in use
+    std::size_t vectorWaste = 0;
+};
+
+// Type for reporting the runtime counters of the data structures,
+// the counters are updated only when compiled with USE_OP_STATS
+struct OperationStats
+{
+    bool enabled = false;
+    // Number of calls of each operation that has been called, in the order they should be reported
+    std::vector<std::pair<std::string, unsigned long long int>> calls = {};
+    // Lookups of an affiliation or publication by its ID or coordinates
+    unsigned long long int lookupHits = 0;
+    unsigned long long int lookupMisses = 0;
+    // Rebuilds of the sorted ID vectors and how many times a sorted vector was thrown away
+    unsigned long long int sortedRebuilds = 0;
+    unsigned long long int sortedInvalidations = 0;
+    // Publications visited when following references up or down
+    unsigned long long int chainSteps = 0;
+    // Elements in the vectors returned by the operations
+    unsigned long long int elementsCopied = 0;
+};
+
+// Type for reporting which affiliations have changed, so that a view of them can be updated incrementally
+struct AffiliationChanges
+{
+    // Version of the data after the changes, passed as since to the next query
+    unsigned long long int version = 0;
+    // False if the changes since the given version are no longer known (the log has been
+    // trimmed or the data cleared), then every affiliation has to be treated as changed
+    bool complete = false;
+    // Affiliations that were added, removed or moved or whose publications changed, may contain duplicates
+    std::vector<AffiliationID> changed = {};
+};
+
 // This is the class you are supposed to implement
 
 class Datastructures
@@ -166,8 +233,9 @@ public:
     // Short rationale for estimate: find is O(n) and everything else is O(1)
     std::vector<AffiliationID> get_affiliations(PublicationID id);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: find is O(n) and everything else is O(1)
+    // Estimate of performance: O(1) on average, O(n) at worst
+    // Short rationale for estimate: find is O(1) on average and O(n) at worst, the citation counts are only
+    // marked out of date and everything else is O(1)
     bool add_reference(PublicationID id, PublicationID parentid);
 
     // Estimate of performance: O(n)
@@ -201,8 +269,8 @@ public:
     // Short rationale for estimate: in the worst case visits all children once
     std::vector<PublicationID> get_all_references(PublicationID id);
 
-    // Estimate of performance: O(nlog(n))
-    // Short rationale for estimate: sort is O(nlog(n))
+    // Estimate of performance: O(1) on average
+    // Short rationale for estimate: get_affiliations_nearest with k = 3
     std::vector<AffiliationID> get_affiliations_closest_to(Coord xy);
 
     // Estimate of performance: O(n)
@@ -214,12 +282,182 @@ public:
     PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2);
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: for loop is O(n)
+    // Short rationale for estimate: removing the ID from publicationVec is O(n), the other containers are updated
+    // in time depending on the affiliations, title words and references of the publication, and the citation
+    // counts are only marked out of date
     bool remove_publication(PublicationID publicationid);
 
+    // Estimate of performance: O(k log(n+k))
+    // Short rationale for estimate: k insertions into the maps, the containers
+    // are reserved and the sorted vectors invalidated only once
+    unsigned int add_affiliations(std::vector<AffiliationData> const& newAffiliations);
+
+    // Estimate of performance: O(k)
+    // Short rationale for estimate: k insertions and references, the containers are reserved only once
+    unsigned int add_publications(std::vector<PublicationData> const& newPublications);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: visits every element of every container once
+    MemoryUsage memory_usage();
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: fixed number of counters
+    OperationStats take_operation_stats();
+
+    // Estimate of performance: O(k log(k)) on average, O(n log(k)) worst case
+    // Short rationale for estimate: grid cells are visited in rings around xy only until
+    // no unvisited cell can be closer than the k:th closest affiliation found
+    std::vector<AffiliationID> get_affiliations_nearest(Coord xy, unsigned int k);
+
+    // Estimate of performance: O(c + m log(m)), c grid cells overlapping the circle, m affiliations returned
+    // Short rationale for estimate: the cells overlapping the circle are visited, at most all nonempty cells
+    std::vector<AffiliationID> get_affiliations_within(Coord xy, Distance radius);
+
+    // Estimate of performance: O(c + m), c grid cells overlapping the box, m affiliations returned
+    // Short rationale for estimate: only the cells overlapping the box are visited, at most all nonempty cells
+    std::vector<AffiliationID> get_affiliations_in_box(Coord min, Coord max);
+
+    // Estimate of performance: O(k), k changes since the given version
+    // Short rationale for estimate: copies the end of the change log
+    AffiliationChanges get_affiliation_changes(unsigned long long int since);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: the bounding box is maintained by the grid
+    // Returns {NO_COORD, NO_COORD} if there are no affiliations, the box may be too large after removals
+    std::pair<Coord, Coord> get_affiliation_bounds();
+
+    // Estimate of performance: O(d log(d)), d collaborators of the affiliation
+    // Short rationale for estimate: the collaborators are maintained, only sorting them by weight remains
+    // Collaborators share at least one publication with the affiliation, the weight is the number of shared publications
+    std::vector<std::pair<AffiliationID, Weight>> get_collaborators(AffiliationID id);
+
+    // Estimate of performance: O(n + e) worst case, usually much less
+    // Short rationale for estimate: bidirectional breadth-first search from both ends, always expanding
+    // the smaller frontier, stops at the first level where the searches meet
+    // Returns the shortest chain of collaborating affiliations from source to target, both included
+    std::vector<AffiliationID> get_collaboration_path(AffiliationID source, AffiliationID target);
+
+    // Estimate of performance: O((n + e) log(n)) worst case, usually much less
+    // Short rationale for estimate: bidirectional Dijkstra from both ends, stops when the two searches can't improve the path
+    // Returns the chain of collaborating affiliations from source to target with the shortest total distance between
+    // the coordinates of consecutive affiliations
+    std::vector<AffiliationID> get_collaboration_path_by_distance(AffiliationID source, AffiliationID target);
+
+    // Estimate of performance: O(1) if the references haven't changed, otherwise O(n log(n)) more
+    // Short rationale for estimate: the counts are read from the publications, after add_reference and
+    // remove_publication all of them are counted again in one pass over the references and mostCited is rebuilt
+    // Returns the number of publications that reference the publication directly or through other publications,
+    // NO_VALUE if the publication doesn't exist. A reference closing a cycle isn't counted.
+    int get_citation_count(PublicationID id);
+
+    // Estimate of performance: O(k) if the references haven't changed, otherwise O(n log(n)) more
+    // Short rationale for estimate: the publications are kept ordered by the citation count, new publications are
+    // inserted in O(log(n)) and after add_reference and remove_publication the order is rebuilt as in
+    // get_citation_count
+    // Returns the k most cited publications, equal counts in the order of the IDs
+    std::vector<PublicationID> get_most_cited(unsigned int k);
+
+    // Estimate of performance: O(r + k), r years in the range, k publications returned
+    // Short rationale for estimate: the publications are bucketed by year, only the buckets in the range are visited
+    // Returns the publications published from year first to year last (inclusive) in the order of the years,
+    // the publications of the same year in no particular order
+    std::vector<std::pair<Year, PublicationID>> get_publications_between(Year first, Year last);
+
+    // Estimate of performance: O(log(Y)), Y the number of possible years
+    // Short rationale for estimate: two prefix sums of a Fenwick tree over the years
+    unsigned int count_publications_between(Year first, Year last);
+
+    // Estimate of performance: O(r), r years in the range
+    // Short rationale for estimate: visits the bucket of every year in the range once
+    // Returns the number of publications of each year from first to last that has publications
+    std::vector<std::pair<Year, unsigned int>> get_publication_counts_by_year(Year first, Year last);
+
+    // Estimate of performance: O(log(n) + k) if the names haven't changed, otherwise O(n) more
+    // Short rationale for estimate: binary search in the sorted name table and k names after it,
+    // the table is rebuilt from affilAlphabetic after the affiliations have changed
+    // Returns at most limit affiliations whose name starts with prefix in alphabetical order, affiliations with
+    // the same name are all kept and ordered by their IDs
+    std::vector<AffiliationID> find_affiliations_by_prefix(Name const& prefix, unsigned int limit);
+
+    // Estimate of performance: O(t + s B + m / B), s publications with the rarest term, m with the most common one,
+    // B the block size of the posting lists
+    // Short rationale for estimate: the posting lists of the terms are intersected starting from the shortest, the
+    // blocks of the longer lists are skipped by their headers and only the blocks that may contain a match are decoded
+    // Returns the publications whose title contains all the words of terms (case-insensitive) in the order of the IDs
+    std::vector<PublicationID> search_publications(std::string const& terms);
+
+    // Estimate of performance: O(t + c (l + log(k))), t the lengths of the trigram lists of the name that aren't frequent,
+    // c affiliations in those lists, l the length of the names
+    // Short rationale for estimate: only the affiliations found from the trigram index of the name are scored, the
+    // lists of the frequent trigrams are skipped and the candidates are scored from their names instead. The best k
+    // are picked by a partial sort.
+    // Returns the k affiliations whose names are the most similar to name, most similar first and equal similarities
+    // in the order of the IDs. Similarity is the Jaccard similarity of the sets of letter trigrams of the names.
+    // A trigram is frequent when more than the larger of FREQUENT_TRIGRAM_MIN and 1 / FREQUENT_TRIGRAM_DIVISOR of
+    // the affiliations have it. Affiliations sharing only frequent trigrams with the name aren't found, unless all
+    // the trigrams of the name are frequent.
+    std::vector<AffiliationID> find_similar_affiliations(Name const& name, unsigned int k);
+
+    // Estimate of performance: O(s B + m / B), s publications of the affiliation with fewer of them, m of the other one
+    // Short rationale for estimate: the shorter compressed publication list is decoded, and from the longer one only
+    // the blocks that may contain its publications, the others are skipped by their headers
+    // Returns the publications of both affiliations in the order of the IDs, NO_PUBLICATION if either doesn't exist
+    std::vector<PublicationID> get_common_publications(AffiliationID id1, AffiliationID id2);
+
+    // Estimate of performance: O(a (s B + m / B)), a affiliations, s publications of the one with the fewest, m the most
+    // Short rationale for estimate: as get_common_publications, the lists are intersected starting from the shortest
+    // Returns the publications of all the affiliations in the order of the IDs, NO_PUBLICATION if one of them doesn't exist
+    std::vector<PublicationID> get_common_publications_of(std::vector<AffiliationID> const& ids);
+
+    // Estimate of performance: O(b log(a) + c log(k)), b bands of the signature, a affiliations, c affiliations in
+    // the same buckets, O(a b) for the first search after the publications of affiliations have changed
+    // Short rationale for estimate: the candidates are only the affiliations sharing a locality-sensitive hashing bucket
+    // with the affiliation, each is scored by comparing the MinHash signatures and the best k are picked by a partial sort.
+    // The buckets of the changed affiliations are updated in one pass by the first search after the changes.
+    // Returns at most k affiliations whose publications are the most similar to those of the affiliation, most similar
+    // first and equal similarities in the order of the IDs. Similarity is the estimated Jaccard similarity of the
+    // publication sets. Affiliations sharing less than about a quarter of their publications are usually not found.
+    // Returns NO_AFFILIATION if the affiliation doesn't exist.
+    std::vector<AffiliationID> get_similar_affiliations(AffiliationID id, unsigned int k);
+
 
 private:
 
+    struct Affiliation;
+    using AffiliationEntry = std::pair<const AffiliationID, Affiliation>;
+
+    // Compressed list of publication IDs in increasing order for the intersections. The IDs are split into
+    // blocks of at most POSTING_BLOCK_SIZE IDs. A block starts with a header of three varints: the first ID,
+    // the difference of the last and the first ID and the byte length of the rest of the block.
+    // The rest are the differences of the consecutive IDs as varints. An intersection skips the blocks that
+    // end before the next ID it looks for by reading only their headers.
+    struct PostingList
+    {
+        std::vector<unsigned char> bytes = {};
+        unsigned int size = 0;
+        // Byte offset of the last block, the IDs larger than all the others are appended to it
+        std::size_t lastBlock = 0;
+    };
+    static std::size_t const POSTING_BLOCK_SIZE = 64;
+
+    // MinHash signature of the publications of an affiliation, value i is the smallest hash of the publications
+    // with hash function i. The signature is split into bands of LSH_ROWS values for the locality-sensitive hashing,
+    // two affiliations sharing a fraction j of their publications have the same values in a band with probability
+    // j^LSH_ROWS, so with 16 bands of 2 rows a pair with j = 0.25 is found in at least one bucket about 65 % of the time.
+    static std::size_t const MINHASH_SIZE = 32;
+    static std::size_t const LSH_ROWS = 2;
+    using MinHashSignature = std::array<unsigned int, MINHASH_SIZE>;
+
+    // State of an affiliation in one direction of a collaboration path search. Valid only when epoch is
+    // searchEpoch, so that the states don't have to be cleared between the searches.
+    struct SearchState
+    {
+        unsigned int epoch = 0;
+        double distance = 0;
+        // The affiliation this one was reached from
+        AffiliationEntry* previous = nullptr;
+    };
+
     // Struct for an affiliation
     struct Affiliation
     {
@@ -228,6 +466,22 @@ private:
         // Vector for all of the publications that related to this affiliation
         // first in the pair is the publication and second is publication year.
         std::vector<std::pair<PublicationID, Year>> affiliatedPubs = {};
+        // Affiliations sharing publications with this one and the number of shared publications,
+        // sorted by the address of the affiliation. Kept symmetric between the two affiliations.
+        std::vector<std::pair<AffiliationEntry*, Weight>> collaborators = {};
+        // Search states forward from the source and backward from the target of a collaboration path search
+        SearchState search[2] = {};
+        // Number of distinct trigrams in the name, and the number of them shared with the name
+        // of a similarity search while the search is running
+        unsigned int trigramCount = 0;
+        unsigned int sharedTrigrams = 0;
+        // IDs of the publications listing this affiliation, once for every time they list it
+        PostingList publicationList = {};
+        // Signature of the publicationList, and true when the affiliation has publications
+        MinHashSignature signature = {};
+        bool hashed = false;
+        // Index in lshPending while the LSH buckets don't have the current signature, otherwise NOT_PENDING
+        std::size_t lshPending = NOT_PENDING;
     };
 
     // Unordered map containing all the affiliations where the key is the
@@ -250,6 +504,17 @@ private:
         // Pair containing the parent of this publication (the publication that this
         // publication references).
         std::pair<PublicationID, Publication*> parent = {NO_PUBLICATION,nullptr};
+        // Number of publications that reference this publication directly or through other
+        // publications, that is the size of the subtree of children without this publication.
+        // Up to date only when citationsCounted is true.
+        unsigned int citations = 0;
+        // The count_citations round that last counted citations, and whether the publication is on
+        // the path of the ongoing count
+        unsigned int citationRound = 0;
+        bool citationsOnPath = false;
+        // Number of times this publication is in the children of other publications. A publication
+        // referenced again stays in the children of its earlier parents too.
+        unsigned int timesReferenced = 0;
     };
 
     // Unordered_map containing all of the publications where the key is the
@@ -261,8 +526,9 @@ private:
 
     // Map for storing all of the affiliations in an alphabetical order
     // according to the name of the affiliation. Key is the name and
-    // the value is the ID of the affiliation.
-    std::map<Name, AffiliationID> affilAlphabetic = {};
+    // the value is the ID of the affiliation. Affiliations with the same
+    // name are in the order they were added.
+    std::multimap<Name, AffiliationID> affilAlphabetic = {};
 
     // Map for storing all of the affiliations in a distance
     // increasing order from the origin (0,0). Key is the
@@ -278,6 +544,14 @@ private:
     // Bool value that is true when the affilIDVecAlph is sorted
     // and false when not.
     bool alphabeticallySorted = true;
+    // Sorted string table of the names for the prefix searches, the names of affilIDVecAlph
+    // concatenated in the same order. Name i is the characters from nameTableOffsets[i] to
+    // nameTableOffsets[i + 1]. Built together with affilIDVecAlph.
+    std::string nameTableChars = {};
+    std::vector<std::size_t> nameTableOffsets = {};
+
+    // Helper function that rebuilds affilIDVecAlph and the name table if they aren't up to date
+    void sort_alphabetically();
 
     // Vectir containing all of the affiliationID's sorted
     // by the distance from origin of the affiliation.
@@ -286,8 +560,183 @@ private:
     // and false when not.
     bool distIncrSorted = true;
 
-    // Helper recursive function for the get_all_references function.
-    void get_all_references_recursive(const Publication& publication, std::vector<PublicationID>& references);
+    // Set containing the citation counts and the IDs of all the publications, most cited first
+    // and equal counts in the order of the IDs
+    struct MoreCited
+    {
+        bool operator()(std::pair<unsigned int, PublicationID> const& publication1,
+                        std::pair<unsigned int, PublicationID> const& publication2) const
+        {
+            if (publication1.first != publication2.first) { return publication1.first > publication2.first; }
+            return publication1.second < publication2.second;
+        }
+    };
+    std::set<std::pair<unsigned int, PublicationID>, MoreCited> mostCited = {};
+    // Bool value that is false when references have been added or publications removed after the
+    // citations were last counted. Then the counts and mostCited are out of date.
+    bool citationsCounted = true;
+    unsigned int citationRound = 0;
+
+    // Helper function that counts the citations of all the publications again and rebuilds mostCited
+    // if they aren't up to date
+    void count_citations();
+
+    // Publications bucketed by the publish year, indexed by the year, and a Fenwick tree of the number of
+    // publications in each year for the range counts. Both are allocated when the first publication is added.
+    std::vector<std::vector<PublicationID>> yearBuckets = {};
+    std::vector<unsigned int> yearCounts = {};
+
+    // Helper functions for the year index
+    void year_index_insert(PublicationID id, Year year);
+    void year_index_erase(PublicationID id, Year year);
+    // Number of publications published before year
+    unsigned int year_count_before(unsigned int year) const;
+
+    // Inverted index of the publication titles. Key is a word in lowercase and value the publications
+    // with the word in the title.
+    std::unordered_map<std::string, PostingList> titleIndex = {};
+
+    // Helper functions for the title index
+    void title_index_insert(PublicationID id, Name const& heading);
+    void title_index_erase(PublicationID id, Name const& heading);
+
+    // Helper functions for the posting lists. Inserting and erasing re-encode only the block of the ID.
+    // Intersecting returns the IDs that are in all of the lists, each once.
+    void posting_insert(PostingList& list, PublicationID id);
+    void posting_erase(PostingList& list, PublicationID id);
+    std::vector<PublicationID> posting_intersection(std::vector<PostingList*>& lists);
+
+    // Helper function that returns the affiliations of the list that exist, a publication lists only existing affiliations
+    std::vector<AffiliationID> existing_affiliations(std::vector<AffiliationID> const& affiliationsOfPub) const;
+
+    // Helper functions that link the publication to its affiliations, to the affiliatedPubs and the
+    // publication lists of the affiliations, and remove it from the publication lists
+    void link_publication(PublicationID id, Year year, std::vector<AffiliationID> const& affiliationsOfPub);
+    void unlink_publication(PublicationID id, std::vector<AffiliationID> const& affiliationsOfPub);
+
+    // Locality-sensitive hashing buckets of the MinHash signatures, sorted by the key of the bucket. Key is
+    // the hash of the band number and the values of the band, every hashed affiliation that isn't pending
+    // has one entry per band.
+    std::vector<std::pair<unsigned long long int, AffiliationEntry*>> lshBuckets = {};
+    // Affiliations whose signature has changed since their entries were put in the buckets, and the
+    // addresses of the affiliations whose entries in the buckets are out of date. The addresses of the
+    // removed affiliations are only compared, never dereferenced.
+    std::vector<AffiliationEntry*> lshPending = {};
+    std::vector<AffiliationEntry*> lshStale = {};
+    static std::size_t const NOT_PENDING = std::numeric_limits<std::size_t>::max();
+
+    // Helper functions for the MinHash signatures. Adding a publication only lowers the values, removing
+    // one needs the signature to be rebuilt from the publication list. Changing a signature only marks the
+    // affiliation pending, the buckets are updated for all the pending affiliations at once when searched.
+    void minhash_add(AffiliationEntry* affiliation, PublicationID id);
+    void minhash_rebuild(AffiliationEntry* affiliation);
+    void lsh_mark_pending(AffiliationEntry* affiliation);
+    void lsh_remove(AffiliationEntry* affiliation);
+    void lsh_update();
+
+    // Trigram index of the affiliation names. Key is three characters of the lowercase name packed into
+    // an integer and value the affiliations whose name contains them, in no particular order.
+    std::unordered_map<unsigned int, std::vector<AffiliationEntry*>> trigramIndex = {};
+
+    // Limits of a frequent trigram for find_similar_affiliations
+    static std::size_t const FREQUENT_TRIGRAM_MIN = 1024;
+    static std::size_t const FREQUENT_TRIGRAM_DIVISOR = 64;
+
+    // Helper functions for the trigram index
+    void trigram_index_insert(AffiliationEntry* affiliation);
+    void trigram_index_erase(AffiliationEntry* affiliation);
+
+    // Helper function for the get_all_references function.
+    void get_all_references_iterative(const Publication& publication, std::vector<PublicationID>& references);
+
+    // Helper function that removes the publication id from the references of parent, returns how many
+    // times it was there
+    unsigned int unlink_reference(Publication& parent, PublicationID id);
+
+    // Uniform grid of the affiliation coordinates for the spatial queries. Key is the cell
+    // (coordinates divided by gridCellSize, rounded down) and value the affiliations in the cell.
+    std::unordered_map<Coord, std::vector<std::pair<Coord, AffiliationID>>, CoordHash> grid = {};
+    int gridCellSize = 1;
+    // Bounding box of the coordinates in the grid, may be too large after removals
+    Coord gridMinCoord = NO_COORD;
+    Coord gridMaxCoord = NO_COORD;
+    // The cell size is checked again when there are this many affiliations
+    std::size_t gridRebuildAt = 16;
+
+    // Helper functions for the grid
+    Coord grid_cell(Coord xy) const;
+    void grid_insert(AffiliationID const& id, Coord xy);
+    void grid_erase(AffiliationID const& id, Coord xy);
+    void grid_rebuild();
+    // Calls func for every (coordinates, ID) pair in the grid with coordinates inside the box
+    template <typename Func>
+    void grid_for_each_in_box(Coord min, Coord max, Func func);
+
+    // Log of the changed affiliations, changeLog[i] made the data version changeLogStart + i + 1.
+    // Half of the log is dropped when it grows past CHANGE_LOG_LIMIT entries.
+    std::vector<AffiliationID> changeLog = {};
+    unsigned long long int changeLogStart = 0;
+    static std::size_t const CHANGE_LOG_LIMIT = 1 << 16;
+
+    // Helper function for adding an affiliation to the change log
+    void log_change(AffiliationID const& id);
+
+    // Helper function that adds change to the collaboration weights between id and each of the distinct
+    // affiliations in [begin, end) other than id. Weights that drop to zero are removed.
+    void change_collaborations(AffiliationID const& id, std::vector<AffiliationID>::const_iterator begin,
+                               std::vector<AffiliationID>::const_iterator end, Weight change);
+    // Adds change to the weight of every distinct pair of the affiliations of a publication once,
+    // however many times the affiliations are listed
+    void change_collaborations(std::vector<AffiliationID> const& affiliationsOfPub, Weight change);
+    // Returns the entry of collaborator in the collaborators of affiliation, inserted with weight zero if it isn't there
+    std::vector<std::pair<AffiliationEntry*, Weight>>::iterator find_collaborator(AffiliationEntry* affiliation,
+                                                                                 AffiliationEntry* collaborator);
+
+    // The current collaboration path search, and the frontiers and heaps of the searches,
+    // kept between the searches so that a search doesn't allocate them again
+    unsigned int searchEpoch = 0;
+    std::vector<AffiliationEntry*> searchFrontier[2] = {};
+    std::vector<AffiliationEntry*> searchNext = {};
+    std::vector<std::pair<double, AffiliationEntry*>> searchHeap[2] = {};
+
+    // Helper functions for the collaboration path searches
+    void start_search();
+    std::vector<AffiliationID> search_path(AffiliationEntry* forwardEnd, AffiliationEntry* backwardEnd);
+
+#ifdef USE_OP_STATS
+    // Operations whose calls are counted, OPERATION_NAMES in datastructures.cc has their names
+    enum class Operation
+    {
+        GET_AFFILIATION_COUNT, CLEAR_ALL, GET_ALL_AFFILIATIONS, ADD_AFFILIATION, GET_AFFILIATION_NAME,
+        GET_AFFILIATION_COORD, GET_AFFILIATIONS_ALPHABETICALLY, GET_AFFILIATIONS_DISTANCE_INCREASING,
+        FIND_AFFILIATION_WITH_COORD, CHANGE_AFFILIATION_COORD, ADD_PUBLICATION, ALL_PUBLICATIONS,
+        GET_PUBLICATION_NAME, GET_PUBLICATION_YEAR, GET_AFFILIATIONS, ADD_REFERENCE, GET_DIRECT_REFERENCES,
+        ADD_AFFILIATION_TO_PUBLICATION, GET_PUBLICATIONS, GET_PARENT, GET_PUBLICATIONS_AFTER,
+        GET_REFERENCED_BY_CHAIN, GET_ALL_REFERENCES, GET_AFFILIATIONS_CLOSEST_TO, REMOVE_AFFILIATION,
+        GET_CLOSEST_COMMON_PARENT, REMOVE_PUBLICATION, ADD_AFFILIATIONS, ADD_PUBLICATIONS, MEMORY_USAGE,
+        GET_AFFILIATIONS_NEAREST, GET_AFFILIATIONS_WITHIN, GET_AFFILIATIONS_IN_BOX,
+        GET_AFFILIATION_CHANGES, GET_AFFILIATION_BOUNDS, GET_COLLABORATORS,
+        GET_COLLABORATION_PATH, GET_COLLABORATION_PATH_BY_DISTANCE, GET_CITATION_COUNT, GET_MOST_CITED,
+        GET_PUBLICATIONS_BETWEEN, COUNT_PUBLICATIONS_BETWEEN, GET_PUBLICATION_COUNTS_BY_YEAR,
+        FIND_AFFILIATIONS_BY_PREFIX, SEARCH_PUBLICATIONS, FIND_SIMILAR_AFFILIATIONS,
+        GET_COMMON_PUBLICATIONS, GET_COMMON_PUBLICATIONS_OF, GET_SIMILAR_AFFILIATIONS,
+        COUNT
+    };
+
+    // Relaxed atomics, so that the counters can be read while another thread runs operations
+    struct Counters
+    {
+        std::array<std::atomic<unsigned long long>, static_cast<std::size_t>(Operation::COUNT)> calls{};
+        std::atomic<unsigned long long> lookupHits{0};
+        std::atomic<unsigned long long> lookupMisses{0};
+        std::atomic<unsigned long long> sortedRebuilds{0};
+        std::atomic<unsigned long long> sortedInvalidations{0};
+        std::atomic<unsigned long long> chainSteps{0};
+        std::atomic<unsigned long long> elementsCopied{0};
+    };
+
+    Counters counters_;
+#endif
 };
 
 #endif // DATASTRUCTURES_HH
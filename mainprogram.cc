@@ -78,6 +78,9 @@ using std::vector;
 #include <set>
 using std::set;
 
+#include <map>
+using std::map;
+
 #include <array>
 using std::array;
 
@@ -109,20 +112,109 @@ using std::transform;
 #include <iterator>
 using std::back_inserter;
 
+#include <thread>
+using std::thread;
+
 #include <cstddef>
 #include <cassert>
 
+#ifdef USE_ALLOC_COUNT
+#include <new>
+using std::bad_alloc;
+using std::nothrow_t;
+using std::align_val_t;
+
+#include <cstdint>
+#include <limits>
+#endif
+
 
 #include "mainprogram.hh"
 
 #include "datastructures.hh"
 
+#include "tracing.hh"
+
 #ifdef GRAPHICAL_GUI
 #include "mainwindow.hh"
 #endif
 
 string const MainProgram::PROMPT = "> ";
 
+// Initialized before main() is entered, for reporting the start-up time
+static auto const program_start_time = std::chrono::steady_clock::now();
+
+#ifdef USE_ALLOC_COUNT
+AllocCounters alloc_counters;
+
+// Every block is prefixed with a header, so that operator delete can update the live byte count and find
+// the start of the block. The header is right before the returned pointer, in an alignment unit of its own.
+struct AllocHeader
+{
+    std::size_t size;
+    std::size_t offset;
+};
+static_assert(sizeof(AllocHeader) <= alignof(std::max_align_t), "The header must fit in one alignment unit");
+
+static void* counted_alloc(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) noexcept
+{
+    std::size_t offset = std::max(alignment, alignof(std::max_align_t));
+    if (size > std::numeric_limits<std::size_t>::max() - 2 * offset) { return nullptr; }
+    // aligned_alloc needs a size that is a multiple of the alignment
+    void* block = (offset == alignof(std::max_align_t)) ? std::malloc(size + offset)
+                                                         : std::aligned_alloc(offset, (size + 2 * offset - 1) / offset * offset);
+    if (!block) { return nullptr; }
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block) + offset;
+    *reinterpret_cast<AllocHeader*>(address - sizeof(AllocHeader)) = {size, offset};
+
+    alloc_counters.count.fetch_add(1, std::memory_order_relaxed);
+    alloc_counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    long long live = alloc_counters.live.fetch_add(size, std::memory_order_relaxed) + size;
+    long long peak = alloc_counters.peak.load(std::memory_order_relaxed);
+    while (live > peak && !alloc_counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+
+    return reinterpret_cast<void*>(address);
+}
+
+static void counted_free(void* ptr) noexcept
+{
+    if (!ptr) { return; }
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    AllocHeader header = *reinterpret_cast<AllocHeader*>(address - sizeof(AllocHeader));
+    alloc_counters.live.fetch_sub(header.size, std::memory_order_relaxed);
+    std::free(reinterpret_cast<void*>(address - header.offset));
+}
+
+static void* counted_alloc_or_throw(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+{
+    if (void* ptr = counted_alloc(size, alignment)) { return ptr; }
+    throw bad_alloc();
+}
+
+void* operator new(std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new[](std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new(std::size_t size, nothrow_t const&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, nothrow_t const&) noexcept { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, nothrow_t const&) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, nothrow_t const&) noexcept { counted_free(ptr); }
+
+// Over-aligned types are allocated through these
+void* operator new(std::size_t size, align_val_t alignment) { return counted_alloc_or_throw(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, align_val_t alignment) { return counted_alloc_or_throw(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, align_val_t alignment, nothrow_t const&) noexcept { return counted_alloc(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, align_val_t alignment, nothrow_t const&) noexcept { return counted_alloc(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* ptr, align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, align_val_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t, align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t, align_val_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, align_val_t, nothrow_t const&) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, align_val_t, nothrow_t const&) noexcept { counted_free(ptr); }
+#endif
+
 void MainProgram::test_get_functions(AffiliationID id)
 {
     ds_.get_affiliation_name(id);
@@ -306,6 +398,334 @@ MainProgram::CmdResult MainProgram::cmd_get_affiliations_closest_to(std::ostream
     return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_get_affiliations_nearest(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string kstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+    unsigned int k = convert_string_to<unsigned int>(kstr);
+
+    auto affiliations = ds_.get_affiliations_nearest({x,y}, k);
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_affiliations_within(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string radiusstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+    Distance radius = convert_string_to<Distance>(radiusstr);
+
+    auto affiliations = ds_.get_affiliations_within({x,y}, radius);
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_affiliations_in_box(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string minxstr = *begin++;
+    string minystr = *begin++;
+    string maxxstr = *begin++;
+    string maxystr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord min = {convert_string_to<int>(minxstr), convert_string_to<int>(minystr)};
+    Coord max = {convert_string_to<int>(maxxstr), convert_string_to<int>(maxystr)};
+
+    auto affiliations = ds_.get_affiliations_in_box(min, max);
+    std::sort(affiliations.begin(), affiliations.end());
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_collaborators(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    AffiliationID affiliationid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto collaborators = ds_.get_collaborators(affiliationid);
+
+    if (collaborators.size() == 1 && collaborators.front() == std::make_pair(NO_AFFILIATION, NO_WEIGHT))
+    {
+        output << "No such affiliation (NO_AFFILIATION, NO_WEIGHT returned)" << endl;
+        return {};
+    }
+
+    if (!collaborators.empty())
+    {
+        output << "Collaborators of affiliation ";
+        print_affiliation_brief(affiliationid, output, false);
+        output << ":" << endl;
+        for (auto& [collaboratorid, weight] : collaborators)
+        {
+            output << " ";
+            print_affiliation_brief(collaboratorid, output, false);
+            output << " with " << weight << " shared publication" << (weight == 1 ? "" : "s") << endl;
+        }
+    }
+    else
+    {
+        output << "No collaborators for affiliation ";
+        print_affiliation_brief(affiliationid, output, false);
+        output << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_collaboration_path(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    AffiliationID sourceid = *begin++;
+    AffiliationID targetid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto path = ds_.get_collaboration_path(sourceid, targetid);
+    if (path.empty())
+    {
+        output << "No collaboration path found." << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, path}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_collaboration_path_by_distance(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    AffiliationID sourceid = *begin++;
+    AffiliationID targetid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto path = ds_.get_collaboration_path_by_distance(sourceid, targetid);
+    if (path.empty())
+    {
+        output << "No collaboration path found." << endl;
+    }
+    else if (path.front() != NO_AFFILIATION)
+    {
+        double distance = 0;
+        for (unsigned int i = 1; i < path.size(); ++i)
+        {
+            auto [x1, y1] = ds_.get_affiliation_coord(path[i-1]);
+            auto [x2, y2] = ds_.get_affiliation_coord(path[i]);
+            distance += std::hypot(static_cast<double>(x2) - x1, static_cast<double>(y2) - y1);
+        }
+        output << "Total distance: " << static_cast<Distance>(distance) << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, path}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_citation_count(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    PublicationID publicationid = convert_string_to<PublicationID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto citations = ds_.get_citation_count(publicationid);
+    if (citations == NO_VALUE)
+    {
+        output << "No such publication (NO_VALUE returned)" << endl;
+        return {};
+    }
+
+    output << "Publication " << publicationid << " is cited by " << citations << " publication" << (citations == 1 ? "" : "s") << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_most_cited(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    unsigned int k = convert_string_to<unsigned int>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto publications = ds_.get_most_cited(k);
+    if (publications.empty())
+    {
+        output << "No publications!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{publications, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_publications_between(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Year first = convert_string_to<Year>(*begin++);
+    Year last = convert_string_to<Year>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto publications = ds_.get_publications_between(first, last);
+    std::sort(publications.begin(), publications.end());
+
+    if (!publications.empty())
+    {
+        output << "Publications between years " << setw(4) << setfill('0') << first << " and " << setw(4) << setfill('0') << last << ":" << endl;
+        for (auto& [year, publicationid] : publications)
+        {
+            output << " " << publicationid << " at " << setw(4) << setfill('0') << year << endl;
+        }
+        output << setfill(' '); // The fill would stay in effect for the following output
+    }
+    else
+    {
+        output << "No publications between years " << first << " and " << last << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_count_publications_between(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Year first = convert_string_to<Year>(*begin++);
+    Year last = convert_string_to<Year>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto count = ds_.count_publications_between(first, last);
+    output << "Number of publications between years " << first << " and " << last << ": " << count << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_publication_counts_by_year(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Year first = convert_string_to<Year>(*begin++);
+    Year last = convert_string_to<Year>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto counts = ds_.get_publication_counts_by_year(first, last);
+
+    if (!counts.empty())
+    {
+        output << "Publications per year between years " << setw(4) << setfill('0') << first << " and " << setw(4) << setfill('0') << last << ":" << endl;
+        for (auto& [year, count] : counts)
+        {
+            output << " " << setw(4) << setfill('0') << year << ": " << count << endl;
+        }
+        output << setfill(' '); // The fill would stay in effect for the following output
+    }
+    else
+    {
+        output << "No publications between years " << first << " and " << last << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_find_affiliations_by_prefix(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string prefix = *begin++;
+    unsigned int limit = convert_string_to<unsigned int>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto affiliations = ds_.find_affiliations_by_prefix(prefix, limit);
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_search_publications(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string terms = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto publications = ds_.search_publications(terms);
+    if (publications.empty())
+    {
+        output << "No publications!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{publications, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_find_similar_affiliations(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string name = *begin++;
+    unsigned int k = convert_string_to<unsigned int>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto affiliations = ds_.find_similar_affiliations(name, k);
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_common_publications(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    AffiliationID id1 = *begin++;
+    AffiliationID id2 = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto publications = ds_.get_common_publications(id1, id2);
+    if (publications.empty())
+    {
+        output << "No publications!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{publications, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_common_publications_of(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string affilsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    vector<AffiliationID> affiliations;
+
+    smatch affil;
+    auto sbeg = affilsstr.cbegin();
+    auto send = affilsstr.cend();
+    for ( ; regex_search(sbeg, send, affil, affil_regex_); sbeg = affil.suffix().first)
+    {
+        affiliations.push_back(affil[1]);
+    }
+
+    auto publications = ds_.get_common_publications_of(affiliations);
+    if (publications.empty())
+    {
+        output << "No publications!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{publications, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_similar_affiliations(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    AffiliationID id = *begin++;
+    unsigned int k = convert_string_to<unsigned int>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto affiliations = ds_.get_similar_affiliations(id, k);
+    if (affiliations.empty())
+    {
+        output << "No affiliations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, affiliations}};
+}
+
 MainProgram::CmdResult MainProgram::cmd_get_closest_common_parent(std::ostream &output, MatchIter begin, MatchIter end)
 {
     PublicationID publicationid1 = convert_string_to<PublicationID>(*begin++);
@@ -466,16 +886,198 @@ void MainProgram::add_random_affiliations_publications(unsigned int size, Coord
         }
         ds_.add_publication(publicationid, convert_to_string(publicationid), get_random_year(), std::move(affiliations));
 
-        // Add area as subarea so that we get a binary tree
-        if (random_publications_added_ > 0)
+        // Add a reference to the parent so that we get a tree of the selected shape (binary by default)
+        auto parent = random_parent(random_publications_added_);
+        random_parents_.push_back(parent);
+        if (parent != random_publications_added_)
         {
-            auto parentid = n_to_publicationid(random_publications_added_ / 2);
+            auto parentid = n_to_publicationid(parent);
             ds_.add_reference(publicationid, parentid);
         }
         ++random_publications_added_;
     }
 }
 
+// Small counter-based random generator. Seeded with the dataset seed plus the index of an item,
+// it gives each item its own stream, so that items can be generated by any thread in any order.
+struct SplitMix64
+{
+    using result_type = unsigned long long int;
+    result_type state;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ull; }
+
+    result_type operator()()
+    {
+        result_type z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+void MainProgram::add_random_affiliations_publications_parallel(unsigned int size, unsigned int threads)
+{
+    unsigned long long int dataset_seed = rand_engine_();
+    dataset_seed = (dataset_seed << 32) ^ rand_engine_();
+
+    // The coordinates are the first size ones of a random permutation of the whole area
+    SplitMix64 coord_keys{dataset_seed};
+    std::unordered_set<Coord,CoordHash> exclude_list;
+    CoordSampler coord_sampler(RANDOM_MIN_COORD, RANDOM_MAX_COORD, exclude_list, coord_keys);
+
+    auto first_affiliation = random_affiliations_added_;
+    auto first_publication = random_publications_added_;
+    vector<AffiliationData> affiliations(size);
+    vector<PublicationData> publications(size);
+
+    auto generate = [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            SplitMix64 item_engine{SplitMix64{dataset_seed + i}()};
+
+            auto n = first_affiliation + i;
+            affiliations[i] = {n_to_affiliationid(n), n_to_name(n), coord_sampler.at(i)};
+
+            auto& publication = publications[i];
+            publication.id = n_to_publicationid(first_publication + i);
+            publication.name = convert_to_string(publication.id);
+            publication.year = uniform_int_distribution<int>(RANDOM_MIN_YEAR, RANDOM_MAX_YEAR-1)(item_engine);
+            uniform_int_distribution<unsigned long int> affiliation_dist(0, first_affiliation + size - 1);
+            for (int j = 0; j < 4; ++j)
+            {
+                publication.affiliations.push_back(n_to_affiliationid(affiliation_dist(item_engine)));
+            }
+        }
+    };
+
+    threads = max(1u, min(threads, size));
+    unsigned int chunk = (size + threads - 1) / threads;
+    vector<thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back(generate, min(size, t*chunk), min(size, (t+1)*chunk));
+    }
+    for (auto& worker : workers) { worker.join(); }
+
+    // Parents are chosen sequentially, because in a power-law tree they depend on the earlier choices
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        auto n = first_publication + i;
+        auto parent = random_parent(n);
+        random_parents_.push_back(parent);
+        if (parent != n) { publications[i].parent = n_to_publicationid(parent); }
+    }
+
+    ds_.add_affiliations(affiliations);
+    ds_.add_publications(publications);
+    random_affiliations_added_ += size;
+    random_publications_added_ += size;
+}
+
+MainProgram::CmdResult MainProgram::cmd_random_add_parallel(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string sizestr = *begin++;
+    string threadsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int size = convert_string_to<unsigned int>(sizestr);
+    unsigned int threads = threadsstr.empty() ? thread::hardware_concurrency() : convert_string_to<unsigned int>(threadsstr);
+
+    // The coordinates are unique only among the ones generated here
+    if (ds_.get_affiliation_count() != 0 || random_affiliations_added_ != 0)
+    {
+        output << "Parallel random add works only on empty data, use clear_all first" << endl;
+        return {};
+    }
+    if (size > static_cast<unsigned long int>(RANDOM_MAX_COORD.x-RANDOM_MIN_COORD.x)*(RANDOM_MAX_COORD.y-RANDOM_MIN_COORD.y))
+    {
+        output << "Impossible to create such number of unique coordinates within perimeters" << endl;
+        return {};
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    add_random_affiliations_publications_parallel(size, threads);
+    stopwatch.stop();
+
+    output << "Added: " << size << " affiliations and publications using " << max(1u, threads) << " thread(s) in "
+           << stopwatch.elapsed() << " sec." << endl;
+
+    view_dirty = true;
+
+    return {};
+}
+
+unsigned long int MainProgram::random_parent(unsigned long int n)
+{
+    if (n == 0) { return n; }
+
+    switch (tree_shape_)
+    {
+    case TreeShape::BINARY:
+        return n / 2;
+    case TreeShape::CHAIN:
+        return n - 1;
+    case TreeShape::STAR:
+        return 0;
+    case TreeShape::KARY:
+        return (n - 1) / tree_shape_param_;
+    case TreeShape::FOREST:
+    {
+        // Binary trees of tree_shape_param_ publications each
+        auto local = n % tree_shape_param_;
+        if (local == 0) { return n; }
+        return n - local + (local - 1) / 2;
+    }
+    case TreeShape::POWERLAW:
+    {
+        // Preferential attachment: pick uniformly from a list containing every earlier publication
+        // once and once more for each reference it has, i.e. [0, 1, parent(1), 2, parent(2), ...]
+        auto pick = random<unsigned long int>(0, 2*n - 1);
+        if (pick == 0) { return 0; }
+        auto k = (pick + 1) / 2;
+        return (pick % 2 == 1) ? k : random_parents_[k];
+    }
+    }
+    assert(!"Unhandled tree shape!");
+    return n;
+}
+
+MainProgram::CmdResult MainProgram::cmd_random_shape(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string shapestr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto colon = shapestr.find(':');
+    string shape = shapestr.substr(0, colon);
+    unsigned long int param = 0;
+    if (colon != string::npos)
+    {
+        param = convert_string_to<unsigned long int>(shapestr.substr(colon+1));
+        if (param == 0)
+        {
+            output << "Invalid shape parameter!" << endl;
+            return {};
+        }
+    }
+
+    if (shape == "binary") { tree_shape_ = TreeShape::BINARY; }
+    else if (shape == "chain") { tree_shape_ = TreeShape::CHAIN; }
+    else if (shape == "star") { tree_shape_ = TreeShape::STAR; }
+    else if (shape == "kary") { tree_shape_ = TreeShape::KARY; }
+    else if (shape == "forest") { tree_shape_ = TreeShape::FOREST; }
+    else if (shape == "powerlaw") { tree_shape_ = TreeShape::POWERLAW; }
+    else { assert(!"Impossible tree shape!"); }
+    tree_shape_param_ = param;
+
+    output << "Random publications reference each other as: " << shapestr << endl;
+
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_random_affiliations(ostream& output, MatchIter begin, MatchIter end)
 {
     string sizestr = *begin++;
@@ -614,43 +1216,17 @@ Year MainProgram::get_random_year(const Year min, const Year max)
 
 std::vector<Coord> MainProgram::get_unique_coords(const unsigned int n, const std::unordered_set<Coord, CoordHash> &exclude_list, const Coord min, const Coord max)
 {
-    const unsigned int max_unique_coords=abs(max.x-min.x)*abs(max.y-min.y)-exclude_list.size();
-    if(n>max_unique_coords){
+    CoordSampler sampler(min, max, exclude_list, rand_engine_);
+    if (n + exclude_list.size() > sampler.size()) {
         throw NotImplemented("Impossible to create such number of unique coordinates within perimeters");
     }
-    //assert(n<max_unique_coords&&"Impossible to create such number of unique coordinates within perimeters");
-
-    if(n>max_unique_coords/2){
-        // let's not use the lottery in this case, let's list the coordinates not in use
-        std::vector<Coord> retvec;
-        retvec.reserve(max_unique_coords);
-        for(auto x = min.x; x<max.x;++x){
-            for(auto y=min.y;y<max.y;++y){
-                Coord newCoord ={x,y};
-                if(exclude_list.find(newCoord)==exclude_list.end()){
-                    retvec.push_back(newCoord);
-                }
-            }
-        }
-        // and get the required number of random_coordinates
-        std::shuffle(retvec.begin(),retvec.end(),rand_engine_);
-        retvec.erase(std::next(retvec.begin(),n),retvec.end());
-        return retvec;
-    } else {
-        std::unordered_set<Coord,CoordHash> coords;
 
-        coords.reserve(n);
-        while(coords.size()<n){
-            Coord newCoord = get_random_coords(min, max);
-            if(exclude_list.find(newCoord)==exclude_list.end()){
-                coords.insert(newCoord);
-            }
-        }
-        std::vector<Coord> retvec(coords.begin(),coords.end());
-        return retvec;
+    std::vector<Coord> retvec;
+    retvec.reserve(n);
+    for (unsigned int i = 0; i < n; ++i) {
+        retvec.push_back(sampler.next());
     }
-
-
+    return retvec;
 }
 
 MainProgram::CmdResult MainProgram::cmd_get_affiliation_count(ostream& output, MatchIter begin, MatchIter end)
@@ -895,34 +1471,203 @@ MainProgram::CmdResult MainProgram::cmd_find_affiliation_with_coord(ostream& /*
 
     auto result = ds_.find_affiliation_with_coord({x,y});
 
-    return {ResultType::IDLIST, CmdResultIDs{{}, {result}}};
+    return {ResultType::IDLIST, CmdResultIDs{{}, {result}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_affiliations(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    auto pubid = convert_string_to<PublicationID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto affiliations = ds_.get_affiliations(pubid);
+    std::sort(affiliations.begin(),affiliations.end());
+    if (affiliations.empty()) { output << "Publication has no affiliations." << std::endl; }
+    return {ResultType::IDLIST, CmdResultIDs{{pubid},affiliations}};
+}
+
+
+MainProgram::CmdResult MainProgram::cmd_memstats(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto usage = ds_.memory_usage();
+
+    unsigned int name_width = 0;
+    for (auto& [name, bytes] : usage.containers) { name_width = max<unsigned int>(name_width, name.length()); }
+
+    std::size_t total = 0;
+    output << "Memory usage (estimated bytes):" << endl;
+    for (auto& [name, bytes] : usage.containers)
+    {
+        output << "  " << std::left << setw(name_width) << name << std::right << " : " << setw(12) << bytes << endl;
+        total += bytes;
+    }
+    output << "  " << std::left << setw(name_width) << "total" << std::right << " : " << setw(12) << total << endl;
+    output << "Unused vector capacity: " << usage.vectorWaste << " bytes" << endl;
+
+    output << "Load factors:" << endl;
+    for (auto& [name, load] : usage.loadFactors)
+    {
+        output << "  " << name << " : " << load << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_stats(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto stats = ds_.take_operation_stats();
+    if (!stats.enabled)
+    {
+        output << "Operation counters are not enabled (compile with USE_OP_STATS)" << endl;
+        return {};
+    }
+
+    unsigned int name_width = 0;
+    for (auto& [name, calls] : stats.calls) { name_width = max<unsigned int>(name_width, name.length()); }
+
+    output << "Calls since the previous stats:" << endl;
+    for (auto& [name, calls] : stats.calls)
+    {
+        output << "  " << std::left << setw(name_width) << name << std::right << " : " << setw(12) << calls << endl;
+    }
+    output << "Lookups: " << stats.lookupHits << " hits, " << stats.lookupMisses << " misses" << endl;
+    output << "Sorted vector rebuilds: " << stats.sortedRebuilds << " (invalidated " << stats.sortedInvalidations << " times)" << endl;
+    output << "Reference chain steps: " << stats.chainSteps << endl;
+    output << "Elements copied on return: " << stats.elementsCopied << endl;
+
+    return {};
+}
+
+AffiliationID MainProgram::random_affiliation()
+{
+    return n_to_affiliationid(random_index(random_affiliations_added_));
+}
+
+PublicationID MainProgram::random_publication()
+{
+    return n_to_publicationid(random_index(random_publications_added_));
+}
+
+bool MainProgram::set_access_distribution(std::string const& str)
+{
+    if (str.empty() || str == "uniform")
+    {
+        access_distribution_ = AccessDistribution::UNIFORM;
+        return true;
+    }
+
+    auto colon = str.find(':');
+    if (colon == string::npos) { return false; }
+    string kind = str.substr(0, colon);
+    double param = 0;
+    try
+    {
+        param = convert_string_to<double>(str.substr(colon+1));
+    }
+    catch (std::invalid_argument const&)
+    {
+        return false;
+    }
+
+    if (kind == "zipf" && param > 0)
+    {
+        access_distribution_ = AccessDistribution::ZIPF;
+        zipf_exponent_ = param;
+        return true;
+    }
+    if (kind == "hotset" && param > 0 && param <= 100)
+    {
+        access_distribution_ = AccessDistribution::HOTSET;
+        hotset_percent_ = param;
+        return true;
+    }
+    return false;
 }
 
-MainProgram::CmdResult MainProgram::cmd_get_affiliations(std::ostream &output, MatchIter begin, MatchIter end)
+unsigned long int MainProgram::random_index(unsigned long int count)
 {
-    auto pubid = convert_string_to<PublicationID>(*begin++);
-    assert( begin == end && "Impossible number of parameters!");
-
-    auto affiliations = ds_.get_affiliations(pubid);
-    std::sort(affiliations.begin(),affiliations.end());
-    if (affiliations.empty()) { output << "Publication has no affiliations." << std::endl; }
-    return {ResultType::IDLIST, CmdResultIDs{{pubid},affiliations}};
-}
-
+    if (access_distribution_ == AccessDistribution::UNIFORM || count == 0)
+    {
+        return random<unsigned long int>(0, count);
+    }
 
+    // Pick a popularity rank, 0 being the most popular
+    unsigned long int rank = 0;
+    if (access_distribution_ == AccessDistribution::ZIPF)
+    {
+        rank = random_zipf_rank(count);
+    }
+    else
+    {
+        unsigned long int hot_count = max(1.0, count * hotset_percent_ / 100);
+        if (hot_count >= count || std::uniform_real_distribution<double>(0, 1)(rand_engine_) < HOTSET_ACCESS_SHARE)
+        {
+            rank = random<unsigned long int>(0, min(hot_count, count));
+        }
+        else
+        {
+            rank = random<unsigned long int>(hot_count, count);
+        }
+    }
 
-AffiliationID MainProgram::random_affiliation()
-{
-    return n_to_affiliationid(random<decltype(random_affiliations_added_)>(0, random_affiliations_added_));
+    // Scatter the ranks over the ids, so that the popular ones are not just the oldest ones
+    // (the multiplier is a prime, so this is a permutation of 0...count-1)
+    return (rank * 2654435761ull) % count;
 }
 
-PublicationID MainProgram::random_publication()
+// Zipf distributed rank in 0...count-1 with rejection-inversion sampling (Hörmann & Derflinger, 1996),
+// which takes constant time and memory regardless of count
+unsigned long int MainProgram::random_zipf_rank(unsigned long int count)
 {
-    return n_to_publicationid(random<decltype(random_publications_added_)>(0, random_publications_added_));
+    double const s = zipf_exponent_;
+    // log(1+x)/x and (exp(x)-1)/x, with the limit values near zero
+    auto helper1 = [](double x){ return std::abs(x) > 1e-8 ? std::log1p(x)/x : 1 - x*(0.5 - x*(1.0/3 - 0.25*x)); };
+    auto helper2 = [](double x){ return std::abs(x) > 1e-8 ? std::expm1(x)/x : 1 + x*0.5*(1 + x/3*(1 + 0.25*x)); };
+    // Integral of the hat function, its inverse, and the (unnormalized) probability of rank x
+    auto hintegral = [&](double x){ double logx = std::log(x); return helper2((1-s)*logx)*logx; };
+    auto hintegral_inv = [&](double x){ double t = max(-1.0, x*(1-s)); return std::exp(helper1(t)*x); };
+    auto h = [&](double x){ return std::exp(-s*std::log(x)); };
+
+    if (count != zipf_count_ || s != zipf_cached_exponent_)
+    {
+        zipf_count_ = count;
+        zipf_cached_exponent_ = s;
+        zipf_h_x1_ = hintegral(1.5) - 1;
+        zipf_h_n_ = hintegral(count + 0.5);
+        zipf_s_ = 2 - hintegral_inv(hintegral(2.5) - h(2));
+    }
+
+    std::uniform_real_distribution<double> uniform(0, 1);
+    while (true)
+    {
+        double u = zipf_h_n_ + uniform(rand_engine_)*(zipf_h_x1_ - zipf_h_n_);
+        double x = hintegral_inv(u);
+        double k = std::floor(x + 0.5);
+        if (k < 1) { k = 1; }
+        else if (k > count) { k = count; }
+        if (k - x <= zipf_s_ || u >= hintegral(k + 0.5) - h(k))
+        {
+            return static_cast<unsigned long int>(k) - 1;
+        }
+    }
 }
 
 PublicationID MainProgram::random_root_publication()
 {
+    // In a star only the center has references, in a forest pick the root of one of the trees
+    if (tree_shape_ == TreeShape::STAR)
+    {
+        return n_to_publicationid(0);
+    }
+    if (tree_shape_ == TreeShape::FOREST)
+    {
+        auto trees = (random_publications_added_ + tree_shape_param_ - 1) / tree_shape_param_;
+        return n_to_publicationid(tree_shape_param_ * random<decltype(random_publications_added_)>(0, trees));
+    }
+
     unsigned long end = ROOT_BIAS_MULTIPLIER * random_publications_added_;
     if (end == 0 ) {
         return 0;
@@ -959,6 +1704,143 @@ void MainProgram::test_affiliations_closest_to()
     ds_.get_affiliations_closest_to(get_random_coords());
 }
 
+void MainProgram::test_get_affiliations_nearest()
+{
+    ds_.get_affiliations_nearest(get_random_coords(), RANDOM_NEAREST_COUNT);
+}
+
+void MainProgram::test_get_affiliations_within()
+{
+    ds_.get_affiliations_within(get_random_coords(), RANDOM_WITHIN_RADIUS);
+}
+
+void MainProgram::test_get_affiliations_in_box()
+{
+    Coord min = get_random_coords({RANDOM_MIN_COORD.x, RANDOM_MIN_COORD.y}, {RANDOM_MAX_COORD.x - RANDOM_BOX_SIZE, RANDOM_MAX_COORD.y - RANDOM_BOX_SIZE});
+    ds_.get_affiliations_in_box(min, {min.x + RANDOM_BOX_SIZE, min.y + RANDOM_BOX_SIZE});
+}
+
+void MainProgram::test_get_collaborators()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto id = random_affiliation();
+        ds_.get_collaborators(id);
+    }
+}
+
+void MainProgram::test_get_collaboration_path()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto id1 = random_affiliation();
+        auto id2 = random_affiliation();
+        ds_.get_collaboration_path(id1, id2);
+    }
+}
+
+void MainProgram::test_get_collaboration_path_by_distance()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto id1 = random_affiliation();
+        auto id2 = random_affiliation();
+        ds_.get_collaboration_path_by_distance(id1, id2);
+    }
+}
+
+void MainProgram::test_get_citation_count()
+{
+    if (random_publications_added_ > 0) // Don't do anything if there's no publications
+    {
+        auto id = random_root_publication();
+        ds_.get_citation_count(id);
+    }
+}
+
+void MainProgram::test_get_most_cited()
+{
+    ds_.get_most_cited(RANDOM_MOST_CITED_COUNT);
+}
+
+void MainProgram::test_get_publications_between()
+{
+    Year first = get_random_year(RANDOM_MIN_YEAR, RANDOM_MAX_YEAR - RANDOM_YEAR_RANGE);
+    ds_.get_publications_between(first, first + RANDOM_YEAR_RANGE);
+}
+
+void MainProgram::test_count_publications_between()
+{
+    Year first = get_random_year();
+    Year last = get_random_year(first, RANDOM_MAX_YEAR);
+    ds_.count_publications_between(first, last);
+}
+
+void MainProgram::test_get_publication_counts_by_year()
+{
+    Year first = get_random_year(RANDOM_MIN_YEAR, RANDOM_MAX_YEAR - RANDOM_YEAR_RANGE);
+    ds_.get_publication_counts_by_year(first, first + RANDOM_YEAR_RANGE);
+}
+
+void MainProgram::test_find_affiliations_by_prefix()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto name = ds_.get_affiliation_name(random_affiliation());
+        ds_.find_affiliations_by_prefix(name.substr(0, RANDOM_PREFIX_LENGTH), RANDOM_PREFIX_LIMIT);
+    }
+}
+
+void MainProgram::test_search_publications()
+{
+    if (random_publications_added_ > 0) // Don't do anything if there's no publications
+    {
+        auto name = ds_.get_publication_name(random_publication());
+        ds_.search_publications(name);
+    }
+}
+
+void MainProgram::test_find_similar_affiliations()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto name = ds_.get_affiliation_name(random_affiliation());
+        ds_.find_similar_affiliations(name, RANDOM_SIMILAR_COUNT);
+    }
+}
+
+void MainProgram::test_get_common_publications()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto id1 = random_affiliation();
+        auto id2 = random_affiliation();
+        ds_.get_common_publications(id1, id2);
+    }
+}
+
+void MainProgram::test_get_common_publications_of()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        vector<AffiliationID> affiliations;
+        for (unsigned int i = 0; i < RANDOM_COMMON_AFFILIATION_COUNT; ++i)
+        {
+            affiliations.push_back(random_affiliation());
+        }
+        ds_.get_common_publications_of(affiliations);
+    }
+}
+
+void MainProgram::test_get_similar_affiliations()
+{
+    if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
+    {
+        auto id = random_affiliation();
+        ds_.get_similar_affiliations(id, RANDOM_SIMILAR_COUNT);
+    }
+}
+
 void MainProgram::test_get_closest_common_parent()
 {
     if (random_publications_added_ > 0) // Don't do anything if there's no publications
@@ -1159,6 +2041,251 @@ MainProgram::CmdResult MainProgram::cmd_stopwatch(std::ostream& output, MatchIte
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_trace(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string start = *begin++;
+    string filename = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    if (!start.empty())
+    {
+        trace_start();
+        output << "Tracing started" << endl;
+    }
+    else if (!trace_enabled.load())
+    {
+        output << "Tracing is not on!" << endl;
+    }
+    else
+    {
+        unsigned long long events = 0;
+        unsigned long long dropped = 0;
+        if (trace_stop(filename, events, dropped))
+        {
+            output << "Tracing stopped, wrote " << events << " events to '" << filename << "'";
+            if (dropped > 0) { output << " (" << dropped << " oldest events dropped)"; }
+            output << endl;
+        }
+        else
+        {
+            output << "Tracing stopped, cannot write file '" << filename << "'!" << endl;
+        }
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_journal(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string start = *begin++;
+    string startfilename = *begin++;
+    string stop = *begin++;
+    string replayfilename = *begin++;
+    string modestr = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    if (!start.empty())
+    {
+        if (journal_.is_open()) { journal_.close(); }
+        journal_.open(startfilename);
+        if (!journal_)
+        {
+            journal_.close();
+            output << "Cannot open file '" << startfilename << "'!" << endl;
+            return {};
+        }
+        journal_ << "# prg1 command journal: us since previous command, ns taken, command line" << endl;
+        journal_entries_ = 0;
+        journal_prev_arrival_ = std::chrono::steady_clock::now();
+        output << "Recording commands to '" << startfilename << "'" << endl;
+    }
+    else if (!stop.empty())
+    {
+        if (!journal_.is_open())
+        {
+            output << "No journal is being recorded!" << endl;
+            return {};
+        }
+        journal_.close();
+        output << "Journal recording stopped, " << journal_entries_ << " commands recorded" << endl;
+    }
+    else
+    {
+        // Factor for the original times between commands, 0 = no waiting
+        double timescale = 0;
+        if (modestr == "realtime") { timescale = 1; }
+        else if (modestr.rfind("scale:", 0) == 0)
+        {
+            try { timescale = convert_string_to<double>(modestr.substr(6)); }
+            catch (std::invalid_argument const&) { timescale = -1; }
+            if (!(timescale > 0))
+            {
+                output << "Invalid scale '" << modestr.substr(6) << "'!" << endl;
+                return {};
+            }
+        }
+        journal_replay(replayfilename, timescale, output);
+    }
+
+    return {};
+}
+
+void MainProgram::journal_record(std::string const& line, std::chrono::steady_clock::time_point arrival,
+                                 std::chrono::steady_clock::duration latency)
+{
+    using std::chrono::duration_cast;
+    journal_ << duration_cast<std::chrono::microseconds>(arrival - journal_prev_arrival_).count() << ' '
+             << duration_cast<std::chrono::nanoseconds>(latency).count() << ' ' << line << '\n';
+    journal_prev_arrival_ = arrival;
+    ++journal_entries_;
+}
+
+void MainProgram::journal_replay(std::string const& filename, double timescale, std::ostream& output)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ifstream input(filename);
+    if (!input)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return;
+    }
+
+    struct Entry
+    {
+        std::chrono::microseconds arrival; // From the first command of the journal
+        std::chrono::nanoseconds latency;
+        vector<CmdInfo>::const_iterator cmd;
+        string params;
+        smatch match;
+    };
+
+    // All the commands are parsed before the replay, so that it doesn't include regex matching
+    vector<Entry> entries;
+    unsigned int skipped = 0;
+    std::chrono::microseconds arrival{0};
+    string line;
+    while (getline(input, line))
+    {
+        if (line.empty() || line[0] == '#') { continue; }
+
+        istringstream linestream(line);
+        long long int delta = 0;
+        long long int latency = 0;
+        string cmdline;
+        smatch match;
+        if (!(linestream >> delta >> latency) || !getline(linestream >> std::ws, cmdline)
+            || !regex_match(cmdline, match, cmds_regex_))
+        {
+            ++skipped;
+            continue;
+        }
+        string cmd = match[1];
+        auto pos = find_if(cmds_.cbegin(), cmds_.cend(), [&cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
+        if (!pos->func)
+        {
+            ++skipped;
+            continue;
+        }
+
+        arrival += std::chrono::microseconds(delta);
+        entries.push_back({arrival, std::chrono::nanoseconds(latency), pos, match[2], {}});
+    }
+
+    // The matches point into the parameter strings, so entries can't be modified after this
+    vector<Entry*> valid;
+    for (auto& entry : entries)
+    {
+        if (regex_match(entry.params, entry.match, entry.cmd->param_regex)) { valid.push_back(&entry); }
+        else { ++skipped; }
+    }
+
+    struct Latencies
+    {
+        unsigned int count = 0;
+        std::chrono::nanoseconds journal{0};
+        Clock::duration replay{0};
+    };
+    map<string, Latencies> latencies;
+
+    output << "** Replaying " << valid.size() << " commands from '" << filename << "'" << endl;
+    flush_output(output);
+
+    ostringstream discarded; // Output of the replayed commands isn't shown
+    unsigned int notimplemented = 0;
+    unsigned int replayed = 0;
+    auto start = Clock::now();
+    for (Entry* entry : valid)
+    {
+        if (timescale > 0)
+        {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double, std::micro>(entry->arrival.count() * timescale)));
+        }
+
+        discarded.str("");
+        auto cmdstart = Clock::now();
+        try
+        {
+            (this->*(entry->cmd->func))(discarded, ++(entry->match.begin()), entry->match.end());
+        }
+        catch (NotImplemented const&)
+        {
+            ++notimplemented;
+        }
+        auto cmdlatency = Clock::now() - cmdstart;
+
+        auto& cmdlatencies = latencies[entry->cmd->cmd];
+        ++cmdlatencies.count;
+        cmdlatencies.journal += entry->latency;
+        cmdlatencies.replay += cmdlatency;
+        ++replayed;
+
+        if (check_stop())
+        {
+            output << "Stop pressed, replay interrupted!" << endl;
+            break;
+        }
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    view_dirty = true;
+
+    std::chrono::duration<double> journal_elapsed{0};
+    if (!entries.empty()) { journal_elapsed = entries.back().arrival + entries.back().latency; }
+    output << "Replayed " << replayed << " commands in " << elapsed.count() << " sec (journal: "
+           << journal_elapsed.count() << " sec)";
+    if (skipped > 0) { output << ", skipped " << skipped << " invalid lines"; }
+    if (notimplemented > 0) { output << ", " << notimplemented << " commands not implemented"; }
+    output << endl;
+
+    unsigned int name_width = 20;
+    for (auto& [cmd, cmdlatencies] : latencies) { name_width = max<unsigned int>(name_width, cmd.length()); }
+    auto micros = [](auto duration, unsigned int count) {
+        return std::chrono::duration<double, std::micro>(duration).count() / count;
+    };
+
+    output << std::left << setw(name_width) << "Average latency (us)" << std::right << setw(10) << "count"
+           << setw(14) << "journal" << setw(14) << "replay" << setw(10) << "ratio" << endl;
+    Latencies total;
+    for (auto& [cmd, cmdlatencies] : latencies)
+    {
+        total.count += cmdlatencies.count;
+        total.journal += cmdlatencies.journal;
+        total.replay += cmdlatencies.replay;
+        double journal = micros(cmdlatencies.journal, cmdlatencies.count);
+        double replay = micros(cmdlatencies.replay, cmdlatencies.count);
+        output << std::left << setw(name_width) << cmd << std::right << setw(10) << cmdlatencies.count
+               << setw(14) << journal << setw(14) << replay << setw(10) << (journal > 0 ? replay / journal : 0) << endl;
+    }
+    if (total.count > 0)
+    {
+        double journal = micros(total.journal, total.count);
+        double replay = micros(total.replay, total.count);
+        output << std::left << setw(name_width) << "total" << std::right << setw(10) << total.count
+               << setw(14) << journal << setw(14) << replay << setw(10) << (journal > 0 ? replay / journal : 0) << endl;
+    }
+}
+
 std::string MainProgram::print_affiliation_name(AffiliationID id, std::ostream &output, bool nl)
 {
     try
@@ -1245,24 +2372,54 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
         {"get_publications", "AffiliationID", affiliationidx, &MainProgram::cmd_get_publications, &MainProgram::test_get_publications },
         {"get_all_references", "PublicationID", publicationidx, &MainProgram::cmd_get_all_references, &MainProgram::test_get_all_references },
         {"get_affiliations_closest_to", "(x,y)", coordx, &MainProgram::cmd_get_affiliations_closest_to, &MainProgram::test_affiliations_closest_to },
+        {"get_affiliations_nearest", "(x,y) k", coordx+wsx+numx, &MainProgram::cmd_get_affiliations_nearest, &MainProgram::test_get_affiliations_nearest },
+        {"get_affiliations_within", "(x,y) radius", coordx+wsx+numx, &MainProgram::cmd_get_affiliations_within, &MainProgram::test_get_affiliations_within },
+        {"get_affiliations_in_box", "(minx,miny) (maxx,maxy)", coordx+wsx+coordx, &MainProgram::cmd_get_affiliations_in_box, &MainProgram::test_get_affiliations_in_box },
+        {"get_collaborators", "AffiliationID", affiliationidx, &MainProgram::cmd_get_collaborators, &MainProgram::test_get_collaborators },
+        {"get_collaboration_path", "AffiliationID1 AffiliationID2", affiliationidx+wsx+affiliationidx, &MainProgram::cmd_get_collaboration_path, &MainProgram::test_get_collaboration_path },
+        {"get_collaboration_path_by_distance", "AffiliationID1 AffiliationID2", affiliationidx+wsx+affiliationidx,
+         &MainProgram::cmd_get_collaboration_path_by_distance, &MainProgram::test_get_collaboration_path_by_distance },
+        {"get_citation_count", "PublicationID", publicationidx, &MainProgram::cmd_get_citation_count, &MainProgram::test_get_citation_count },
+        {"get_most_cited", "k", numx, &MainProgram::cmd_get_most_cited, &MainProgram::test_get_most_cited },
+        {"get_publications_between", "Year1 Year2", timex+wsx+timex, &MainProgram::cmd_get_publications_between, &MainProgram::test_get_publications_between },
+        {"count_publications_between", "Year1 Year2", timex+wsx+timex, &MainProgram::cmd_count_publications_between, &MainProgram::test_count_publications_between },
+        {"get_publication_counts_by_year", "Year1 Year2", timex+wsx+timex, &MainProgram::cmd_get_publication_counts_by_year, &MainProgram::test_get_publication_counts_by_year },
+        {"find_affiliations_by_prefix", "\"Prefix\" limit", '"'+namex+'"'+wsx+numx, &MainProgram::cmd_find_affiliations_by_prefix, &MainProgram::test_find_affiliations_by_prefix },
+        {"search_publications", "\"Terms\"", '"'+namex+'"', &MainProgram::cmd_search_publications, &MainProgram::test_search_publications },
+        {"find_similar_affiliations", "\"Name\" k", '"'+namex+'"'+wsx+numx, &MainProgram::cmd_find_similar_affiliations, &MainProgram::test_find_similar_affiliations },
+        {"get_common_publications", "AffiliationID1 AffiliationID2", affiliationidx+wsx+affiliationidx, &MainProgram::cmd_get_common_publications, &MainProgram::test_get_common_publications },
+        {"get_common_publications_of", "AffiliationID AffiliationID ...", "("+affiliationlistx+"(?:"+wsx+affiliationlistx+")*)", &MainProgram::cmd_get_common_publications_of, &MainProgram::test_get_common_publications_of },
+        {"get_similar_affiliations", "AffiliationID k", affiliationidx+wsx+numx, &MainProgram::cmd_get_similar_affiliations, &MainProgram::test_get_similar_affiliations },
         {"remove_affiliation", "AffiliationID", affiliationidx, &MainProgram::cmd_remove_affiliation, &MainProgram::test_remove_affiliation },
         {"get_closest_common_parent", "PublicationID1 PublicationID2", publicationidx+wsx+publicationidx, &MainProgram::cmd_get_closest_common_parent, &MainProgram::test_get_closest_common_parent },
         {"quit", "", "", nullptr, nullptr },
         {"help", "", "", &MainProgram::help_command, nullptr },
         {"random_add", "number_of_affiliations_to_add  (minx,miny) (maxx,maxy) (coordinates optional)",
          numx+"(?:"+wsx+coordx+wsx+coordx+")?", &MainProgram::cmd_random_affiliations, &MainProgram::test_random_affiliations },
+        {"random_add_parallel", "number_of_affiliations_to_add [threads] (parts in [] are optional)",
+         numx+"(?:"+wsx+numx+")?", &MainProgram::cmd_random_add_parallel, nullptr },
         {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
         {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
-        {"perftest", "cmd1[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
-         "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest, nullptr },
+        {"perftest", "cmd1[:weight1][;cmd2[:weight2]...] timeout repeat_count n1[;n2...] [uniform|zipf:exponent|hotset:percent] (parts in [] are optional, alternatives separated by |)",
+         "([0-9a-zA-Z_]+(?::[0-9]+)?(?:;[0-9a-zA-Z_]+(?::[0-9]+)?)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)(?:"+wsx+"(uniform|zipf:[0-9.]+|hotset:[0-9.]+))?",
+         &MainProgram::cmd_perftest, nullptr },
         {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
+        {"journal", "start \"out-filename\"|stop|replay \"in-filename\" [fast|realtime|scale:factor] (parts in [] are optional, alternatives separated by |)",
+         "(?:(start)"+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"|(stop)|replay"+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(fast|realtime|scale:[0-9.]+))?)",
+         &MainProgram::cmd_journal, nullptr },
+        {"trace", "start|stop \"out-filename.json\" (alternatives separated by |)", "(?:(start)|stop"+wsx+"\"([-a-zA-Z0-9 ./:_]+)\")",
+         &MainProgram::cmd_trace, nullptr },
         {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
+        {"random_shape", "binary|chain|star|kary:k|forest:tree_size|powerlaw (alternatives separated by |)",
+         "(binary|chain|star|kary:[0-9]+|forest:[0-9]+|powerlaw)", &MainProgram::cmd_random_shape, nullptr },
         {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
         {"remove_publication","PublicationID",publicationidx, &MainProgram::cmd_remove_publication, &MainProgram::test_remove_publication},
         {"get_parent","PublicationID",publicationidx,&MainProgram::cmd_get_parent, &MainProgram::test_get_parent},
         {"get_referenced_by_chain","PublicationID",publicationidx,&MainProgram::cmd_get_referenced_by_chain,&MainProgram::test_get_referenced_by_chain},
         {"get_affiliations", "PublicationID", publicationidx, &MainProgram::cmd_get_affiliations, &MainProgram::test_get_affiliations},
         {"get_direct_references", "PublicationID", publicationidx, &MainProgram::cmd_get_direct_references, &MainProgram::test_get_direct_references},
+        {"memstats", "", "", &MainProgram::cmd_memstats, nullptr },
+        {"stats", "", "", &MainProgram::cmd_stats, nullptr },
         };
 
 MainProgram::CmdResult MainProgram::help_command(std::ostream& output, MatchIter /*begin*/, MatchIter /*end*/)
@@ -1289,15 +2446,36 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         unsigned int timeout = convert_string_to<unsigned int>(*begin++);
         unsigned int repeat_count = convert_string_to<unsigned int>(*begin++);
         string sizes = *begin++;
+        string distribution = *begin++;
         assert(begin == end && "Invalid number of parameters");
 
+        // The distribution is used only while running the commands, the data is added uniformly
+        if (!set_access_distribution(distribution))
+        {
+            output << "Invalid access distribution '" << distribution << "'!" << endl;
+            return {};
+        }
+        auto cmds_distribution = access_distribution_;
+        access_distribution_ = AccessDistribution::UNIFORM;
+
         vector<string> testcmds;
+        vector<unsigned long int> testweights; // Relative share of each command, 1 if not given
+        bool weighted = false;
         smatch scmd;
         auto cbeg = commandstr.cbegin();
         auto cend = commandstr.cend();
         for ( ; regex_search(cbeg, cend, scmd, commands_regex_); cbeg = scmd.suffix().first)
         {
             testcmds.push_back(scmd[1]);
+            if (scmd[2].matched)
+            {
+                testweights.push_back(convert_string_to<unsigned long int>(scmd[2]));
+                weighted = true;
+            }
+            else
+            {
+                testweights.push_back(1);
+            }
         }
 
 
@@ -1313,24 +2491,51 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         output << "Timeout for each N is " << timeout << " sec. " << endl;
         output << "For each N perform " << repeat_count << " random command(s) from:" << endl;
 
-        // Initialize test functions
+        // Initialize test functions and the cumulative weights used to pick them
         vector<void(MainProgram::*)()> testfuncs;
+        vector<unsigned long int> cumulative_weights;
+        vector<vector<CmdInfo>::iterator> testcmdpos;
+        unsigned long int total_weight = 0;
+        for (unsigned int i = 0; i < testcmds.size(); ++i)
+        {
+            auto& testcmd = testcmds[i];
+            auto pos = find_if(cmds_.begin(), cmds_.end(), [&testcmd](auto const& cmd){ return cmd.cmd == testcmd; });
+            testcmdpos.push_back(pos);
+            if (pos != cmds_.end() && pos->testfunc) { total_weight += testweights[i]; }
+        }
 
-        for (auto& i : testcmds)
+        for (unsigned int i = 0; i < testcmds.size(); ++i)
         {
-            auto pos = find_if(cmds_.begin(), cmds_.end(), [&i](auto const& cmd){ return cmd.cmd == i; });
+            auto& testcmd = testcmds[i];
+            auto pos = testcmdpos[i];
             if (pos != cmds_.end() && pos->testfunc)
             {
-                output << i << " ";
+                if (testweights[i] == 0) { continue; }
+                output << testcmd << " ";
+                if (weighted) { output << "(" << 100.0 * testweights[i] / total_weight << "%) "; }
                 testfuncs.push_back(pos->testfunc);
+                cumulative_weights.push_back((cumulative_weights.empty() ? 0 : cumulative_weights.back()) + testweights[i]);
             }
             else
             {
-                output << "(cannot test " << i << ") ";
+                output << "(cannot test " << testcmd << ") ";
             }
         }
 
-        output << endl << endl;
+        output << endl;
+        switch (cmds_distribution)
+        {
+        case AccessDistribution::UNIFORM:
+            output << "with uniformly random ids" << endl;
+            break;
+        case AccessDistribution::ZIPF:
+            output << "with zipf distributed ids (exponent " << zipf_exponent_ << ")" << endl;
+            break;
+        case AccessDistribution::HOTSET:
+            output << "with " << HOTSET_ACCESS_SHARE*100 << "% of ids from a hot set of " << hotset_percent_ << "% of the ids" << endl;
+            break;
+        }
+        output << endl;
 
         if (testfuncs.empty())
         {
@@ -1340,11 +2545,16 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 
 #ifdef USE_PERF_EVENT
         output << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "add (count)" << " , " << setw(12) << "cmds (sec)" << " , "
-               << setw(12) << "cmds (count)"  << " , " << setw(12) << "total (sec)" << " , " << setw(12) << "total (count)" << endl;
+               << setw(12) << "cmds (count)"  << " , " << setw(12) << "total (sec)" << " , " << setw(12) << "total (count)";
 #else
         output << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "cmds (sec)" << " , "
-               << setw(12) << "total (sec)" << endl;
+               << setw(12) << "total (sec)";
 #endif
+#ifdef USE_ALLOC_COUNT
+        output << " , " << setw(12) << "add (allocs)" << " , " << setw(12) << "add (bytes)" << " , " << setw(12) << "add (peak)"
+               << " , " << setw(12) << "cmds (allocs)" << " , " << setw(12) << "cmds (bytes)" << " , " << setw(12) << "cmds (peak)";
+#endif
+        output << endl;
         flush_output(output);
 
         auto stop = false;
@@ -1358,13 +2568,19 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             init_primes();
 
             Stopwatch stopwatch(true); // Use also instruction counting, if enabled
+            // Unique coordinates are generated lazily, 1000 at a time
             std::unordered_set<Coord,CoordHash> exclude_list;
-            std::vector<Coord> unique_coords = get_unique_coords(n,exclude_list,RANDOM_MIN_COORD,RANDOM_MAX_COORD);
+            CoordSampler coord_sampler(RANDOM_MIN_COORD, RANDOM_MAX_COORD, exclude_list, rand_engine_);
+            if (n > coord_sampler.size())
+            {
+                throw NotImplemented("Impossible to create such number of unique coordinates within perimeters");
+            }
+            std::vector<Coord> vector_slice;
             // Add random affiliations
-            std::vector<Coord>::iterator start_of_range=unique_coords.begin();
-            for (unsigned int i = 0; i < n / 1000; ++i,std::advance(start_of_range,1000))
+            for (unsigned int i = 0; i < n / 1000; ++i)
             {
-                std::vector<Coord> vector_slice(start_of_range,std::next(start_of_range,1000));
+                vector_slice.clear();
+                for (unsigned int j = 0; j < 1000; ++j) { vector_slice.push_back(coord_sampler.next()); }
                 stopwatch.start();
                 add_random_affiliations_publications(1000,RANDOM_MIN_COORD,RANDOM_MAX_COORD,vector_slice);
                 stopwatch.stop();
@@ -1386,7 +2602,8 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 
             if (n % 1000 != 0)
             {
-                std::vector<Coord> vector_slice(start_of_range,unique_coords.end());
+                vector_slice.clear();
+                for (unsigned int j = 0; j < n % 1000; ++j) { vector_slice.push_back(coord_sampler.next()); }
                 stopwatch.start();
                 add_random_affiliations_publications(n % 1000,RANDOM_MIN_COORD,RANDOM_MAX_COORD,vector_slice);
                 stopwatch.stop();
@@ -1396,6 +2613,12 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             auto addcount = stopwatch.count();
 #endif
             auto addsec = stopwatch.elapsed();
+#ifdef USE_ALLOC_COUNT
+            auto addallocs = stopwatch.alloc_count();
+            auto addbytes = stopwatch.alloc_bytes();
+            auto addpeak = stopwatch.alloc_peak();
+            stopwatch.reset_alloc_counts(); // From now on, count only allocations of the commands
+#endif
 
 #ifdef USE_PERF_EVENT
             output << setw(12) << addsec << " , " << setw(12) << addcount << " , " << flush;
@@ -1410,12 +2633,15 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
                 break;
             }
 
+            access_distribution_ = cmds_distribution;
             stopwatch.start();
             for (unsigned int repeat = 0; repeat < repeat_count; ++repeat)
             {
-                auto cmdpos = random(testfuncs.begin(), testfuncs.end());
+                // With all weights 1 this picks each command uniformly, like without weights
+                auto pick = random<unsigned long int>(0, cumulative_weights.back());
+                auto cmdpos = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), pick) - cumulative_weights.begin();
 
-                (this->**cmdpos)();
+                (this->*testfuncs[cmdpos])();
 
                 if (repeat % 10 == 0)
                 {
@@ -1436,6 +2662,7 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
                 }
             }
             stopwatch.stop();
+            access_distribution_ = AccessDistribution::UNIFORM;
             if (stop) { break; }
 
 #ifdef USE_PERF_EVENT
@@ -1448,6 +2675,11 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 #else
             output << setw(12) << totalsec-addsec << " , " << setw(12) << totalsec;
 #endif
+#ifdef USE_ALLOC_COUNT
+            output << " , " << setw(12) << addallocs << " , " << setw(12) << addbytes << " , " << setw(12) << addpeak
+                   << " , " << setw(12) << stopwatch.alloc_count() << " , " << setw(12) << stopwatch.alloc_bytes()
+                   << " , " << setw(12) << stopwatch.alloc_peak();
+#endif
 
             output << endl;
             flush_output(output);
@@ -1462,6 +2694,7 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         // Clean up after NotImplemented
         ds_.clear_all();
         init_primes();
+        access_distribution_ = AccessDistribution::UNIFORM;
         throw;
     }
 
@@ -1482,9 +2715,14 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
 {
 
     if (inputline.empty()) { return true; }
+    TRACE_SCOPE("command_parse_line");
 
     smatch match;
-    bool matched = regex_match(inputline, match, cmds_regex_);
+    bool matched = false;
+    {
+        TRACE_SCOPE("parse command");
+        matched = regex_match(inputline, match, cmds_regex_);
+    }
     if (matched)
     {
         assert(match.size() == 3);
@@ -1495,7 +2733,11 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
         assert(pos != cmds_.end());
 
         smatch match2;
-        bool matched2 = regex_match(params, match2, pos->param_regex);
+        bool matched2 = false;
+        {
+            TRACE_SCOPE("parse parameters");
+            matched2 = regex_match(params, match2, pos->param_regex);
+        }
         if (matched2)
         {
             if (pos->func)
@@ -1515,9 +2757,12 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
                     stopwatch.start();
                 }
 
+                auto command_start = std::chrono::steady_clock::now();
                 CmdResult result;
                 try
                 {
+                    // Command names in cmds_ live as long as the program
+                    TraceScope trace_command(pos->cmd.c_str());
                     result = (this->*(pos->func))(output, ++(match2.begin()), match2.end());
                 }
                 catch (NotImplemented const& e)
@@ -1531,6 +2776,13 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
                     stopwatch.stop();
                 }
 
+                // Commands that run other commands aren't recorded, the commands they run are
+                if (journal_.is_open() && cmd != "journal" && cmd != "read" && cmd != "testread")
+                {
+                    journal_record(inputline, command_start, std::chrono::steady_clock::now() - command_start);
+                }
+
+                TraceScope trace_result("print result");
                 switch (result.first)
                 {
                 case ResultType::NOTHING:
@@ -1603,6 +2855,10 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
 #ifdef USE_PERF_EVENT
                     auto totalcount = stopwatch.count();
                     output << ", cmds (count): " << totalcount;
+#endif
+#ifdef USE_ALLOC_COUNT
+                    output << ", allocs: " << stopwatch.alloc_count() << ", bytes: " << stopwatch.alloc_bytes()
+                           << ", peak: " << stopwatch.alloc_peak();
 #endif
                     output << endl;
                 }
@@ -1652,6 +2908,13 @@ void MainProgram::command_parser(istream& input, ostream& output, PromptStyle pr
         bool cont = command_parse_line(line, output);
         view_dirty = false; // No need to keep track of individual result changes
         if (!cont) { break; }
+
+        // Stop skips the rest of the commands being read
+        if (check_stop())
+        {
+            output << "Stopped!" << endl;
+            break;
+        }
     }
     while (input);
 
@@ -1666,6 +2929,7 @@ void MainProgram::setui(MainWindow* ui)
 #ifdef GRAPHICAL_GUI
 void MainProgram::flush_output(std::ostream& output)
 {
+    TRACE_SCOPE("flush_output");
     if (ui_)
     {
         if (auto soutput = dynamic_cast<ostringstream*>(&output))
@@ -1708,14 +2972,25 @@ int MainProgram::mainprogram(int argc, char* argv[])
 {
     vector<string> args(argv, argv+argc);
 
+    // The start-up time is reported only when asked for, so that the normal output stays the same
+    auto startup_option = std::find(args.begin(), args.end(), "--startup-time");
+    bool report_startup = startup_option != args.end();
+    if (report_startup) { args.erase(startup_option); }
+
     if (args.size() < 1 || args.size() > 2)
     {
-        cerr << "Usage: " + ((args.size() > 0) ? args[0] : "<program name>") + " [<command file>]" << endl;
+        cerr << "Usage: " + ((args.size() > 0) ? args[0] : "<program name>") + " [--startup-time] [<command file>]" << endl;
         return EXIT_FAILURE;
     }
 
     MainProgram mainprg;
 
+    if (report_startup)
+    {
+        std::chrono::duration<double> startup_time = std::chrono::steady_clock::now() - program_start_time;
+        cerr << "Start-up time: " << startup_time.count() << " sec" << endl;
+    }
+
     if (args.size() == 2 && args[1] != "--console")
     {
         string filename = args[1];
@@ -1752,6 +3027,7 @@ void MainProgram::init_primes()
     prime2_ = primes2[random<int>(0, primes2.size())];
     random_affiliations_added_ = 0;
     random_publications_added_ = 0;
+    random_parents_.clear();
 }
 
 Name MainProgram::n_to_name(unsigned long n)
@@ -1806,6 +3082,6 @@ void MainProgram::init_regexs()
     coords_regex_ = regex(coordx+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
     affil_regex_ = regex(affiliationidx+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize); // TODO test this one more intensively
     times_regex_ = regex(wsx+"([0-9][0-9]):([0-9][0-9]):([0-9][0-9])", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    commands_regex_ = regex("([0-9a-zA-Z_]+);?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
+    commands_regex_ = regex("([0-9a-zA-Z_]+)(?::([0-9]+))?;?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
     sizes_regex_ = regex(numx+";?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
 }
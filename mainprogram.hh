@@ -21,6 +21,7 @@
 #include <regex>
 #include <chrono>
 #include <sstream>
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
@@ -39,12 +40,30 @@
 
 const Coord RANDOM_MIN_COORD = {0,0};
 const Coord RANDOM_MAX_COORD = {10000,10000};
+// Parameters of the spatial queries in perftest
+unsigned int const RANDOM_NEAREST_COUNT = 10;
+Distance const RANDOM_WITHIN_RADIUS = 200;
+int const RANDOM_BOX_SIZE = 400;
+// Number of publications asked from get_most_cited in perftest
+unsigned int const RANDOM_MOST_CITED_COUNT = 10;
+// Length of the name prefixes searched in perftest and the number of affiliations asked
+std::size_t const RANDOM_PREFIX_LENGTH = 2;
+unsigned int const RANDOM_PREFIX_LIMIT = 10;
+// Number of similar affiliations asked in perftest
+unsigned int const RANDOM_SIMILAR_COUNT = 10;
+// Number of affiliations whose common publications are asked in perftest
+unsigned int const RANDOM_COMMON_AFFILIATION_COUNT = 3;
 const Year RANDOM_MIN_YEAR = 0;
 const Year RANDOM_MAX_YEAR = 9998;
+// Width of the year ranges queried in perftest
+const Year RANDOM_YEAR_RANGE = 100;
 
 const double ROOT_BIAS_MULTIPLIER = 0.05;
 const double LEAF_BIAS_MULTIPLIER = 0.5;
 
+// share of the random ids picked from the hot set in perftest with hotset distribution
+const double HOTSET_ACCESS_SHARE = 0.9;
+
 class MainWindow; // In case there's UI
 
 class MainProgram
@@ -54,6 +73,7 @@ public:
 
 
     class Stopwatch;
+    class CoordSampler;
 
     enum class PromptStyle { NORMAL, NO_ECHO, NO_NESTING };
     enum class TestStatus { NOT_RUN, NO_DIFFS, DIFFS_FOUND };
@@ -92,6 +112,15 @@ private:
     enum class StopwatchMode { OFF, ON, NEXT };
     StopwatchMode stopwatch_mode = StopwatchMode::OFF;
 
+    // Command journal being recorded, see cmd_journal. Every line has the time since the previous
+    // command (in microseconds), the time the command took (in nanoseconds) and the command line.
+    std::ofstream journal_;
+    std::chrono::steady_clock::time_point journal_prev_arrival_;
+    unsigned long int journal_entries_ = 0;
+    void journal_record(std::string const& line, std::chrono::steady_clock::time_point arrival,
+                        std::chrono::steady_clock::duration latency);
+    void journal_replay(std::string const& filename, double timescale, std::ostream& output);
+
     enum class ResultType { NOTHING, IDLIST};
     using CmdResultIDs = std::pair<std::vector<PublicationID>, std::vector<AffiliationID>>;
 
@@ -138,6 +167,23 @@ private:
     CmdResult cmd_get_publications(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_all_references(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_affiliations_closest_to(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_affiliations_nearest(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_affiliations_within(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_affiliations_in_box(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_collaborators(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_collaboration_path(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_collaboration_path_by_distance(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_citation_count(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_most_cited(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_publications_between(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_count_publications_between(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_publication_counts_by_year(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_find_affiliations_by_prefix(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_search_publications(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_find_similar_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_common_publications(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_common_publications_of(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_similar_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_remove_affiliation(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_closest_common_parent(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_remove_publication(std::ostream& output, MatchIter begin, MatchIter end);
@@ -148,21 +194,50 @@ private:
     CmdResult help_command(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_random_shape(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_random_add_parallel(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_read(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_testread(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_trace(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_journal(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_perftest(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_comment(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_memstats(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stats(std::ostream& output, MatchIter begin, MatchIter end);
 
     // random ids for perftest
     AffiliationID random_affiliation();
     PublicationID random_publication();
 
+    // distribution of the ids picked by random_affiliation() and random_publication()
+    enum class AccessDistribution { UNIFORM, ZIPF, HOTSET };
+    AccessDistribution access_distribution_ = AccessDistribution::UNIFORM;
+    double zipf_exponent_ = 1.0;
+    double hotset_percent_ = 10.0;
+    bool set_access_distribution(std::string const& str);
+    unsigned long int random_index(unsigned long int count);
+    unsigned long int random_zipf_rank(unsigned long int count);
+
+    // values precomputed for zipf rank sampling, valid for zipf_count_ and zipf_exponent_
+    unsigned long int zipf_count_ = 0;
+    double zipf_cached_exponent_ = 0;
+    double zipf_h_x1_ = 0;
+    double zipf_h_n_ = 0;
+    double zipf_s_ = 0;
+
     // biased random ids for some perftest
     PublicationID random_root_publication();
     PublicationID random_leaf_publication();
 
+    // shape of the reference tree formed by the random publications
+    enum class TreeShape { BINARY, CHAIN, STAR, KARY, FOREST, POWERLAW };
+    TreeShape tree_shape_ = TreeShape::BINARY;
+    unsigned long int tree_shape_param_ = 0; // k for KARY, tree size for FOREST
+    std::vector<unsigned long int> random_parents_; // Parent of each random publication (itself if none)
+    unsigned long int random_parent(unsigned long int n);
+
     void test_get_functions(AffiliationID id);
     void test_affiliation_info();
     void test_find_affiliation_with_coord();
@@ -172,6 +247,23 @@ private:
     void test_get_publications();
     void test_get_all_references();
     void test_affiliations_closest_to();
+    void test_get_affiliations_nearest();
+    void test_get_affiliations_within();
+    void test_get_affiliations_in_box();
+    void test_get_collaborators();
+    void test_get_collaboration_path();
+    void test_get_collaboration_path_by_distance();
+    void test_get_citation_count();
+    void test_get_most_cited();
+    void test_get_publications_between();
+    void test_count_publications_between();
+    void test_get_publication_counts_by_year();
+    void test_find_affiliations_by_prefix();
+    void test_search_publications();
+    void test_find_similar_affiliations();
+    void test_get_common_publications();
+    void test_get_common_publications_of();
+    void test_get_similar_affiliations();
     void test_remove_affiliation();
     void test_get_closest_common_parent();
     void test_random_affiliations();
@@ -189,6 +281,7 @@ private:
     inline Year get_random_year(const Year min = RANDOM_MIN_YEAR, const Year max = RANDOM_MAX_YEAR);
     std::vector<Coord> get_unique_coords(const unsigned int n,const std::unordered_set<Coord,CoordHash>& exclude_list,const Coord min=RANDOM_MIN_COORD,const Coord max=RANDOM_MAX_COORD);
     void add_random_affiliations_publications(unsigned int size, Coord min = RANDOM_MIN_COORD, Coord max = RANDOM_MAX_COORD,const std::vector<Coord>& coordinates={});
+    void add_random_affiliations_publications_parallel(unsigned int size, unsigned int threads);
     Distance calc_distance(Coord c1, Coord c2);
     std::string print_affiliation(AffiliationID id, std::ostream& output, bool nl = true);
     std::string print_affiliation_brief(AffiliationID id, std::ostream& output, bool nl = true);
@@ -302,6 +395,23 @@ perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
 }
 #endif
 
+#ifdef USE_ALLOC_COUNT
+#include <atomic>
+#include <algorithm>
+
+// Heap allocation counters, updated by the replacement global operator new/delete
+// in mainprogram.cc. Live and peak are in bytes requested by the program.
+struct AllocCounters
+{
+    std::atomic<unsigned long long> count{0};
+    std::atomic<unsigned long long> bytes{0};
+    std::atomic<long long> live{0};
+    std::atomic<long long> peak{0};
+};
+
+extern AllocCounters alloc_counters;
+#endif
+
 class MainProgram::Stopwatch
 {
 public:
@@ -350,6 +460,9 @@ public:
             read(fd_, &startcount_, sizeof(startcount_));
             ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
         }
+#endif
+#ifdef USE_ALLOC_COUNT
+        alloc_start();
 #endif
     }
 
@@ -365,10 +478,16 @@ public:
         }
 #endif
         elapsed_ += (Clock::now() - starttime_);
+#ifdef USE_ALLOC_COUNT
+        alloc_stop();
+#endif
     }
 
     void reset()
     {
+#ifdef USE_ALLOC_COUNT
+        if (running_) { alloc_stop(); }
+#endif
         running_ = false;
 #ifdef USE_PERF_EVENT
         if (use_counter_)
@@ -379,6 +498,21 @@ public:
         }
 #endif
         elapsed_ = elapsed_.zero();
+        reset_alloc_counts();
+    }
+
+    // Resets only the allocation statistics, so that they can be collected
+    // separately for different phases of a single timing
+    void reset_alloc_counts()
+    {
+#ifdef USE_ALLOC_COUNT
+        if (running_) { alloc_stop(); }
+        allocs_ = 0;
+        allocbytes_ = 0;
+        allocpeak_ = 0;
+        allocfresh_ = true;
+        if (running_) { alloc_start(); }
+#endif
     }
 
     double elapsed()
@@ -417,6 +551,29 @@ public:
     }
 #endif
 
+#ifdef USE_ALLOC_COUNT
+    // Number of allocations made while the stopwatch was running
+    unsigned long long alloc_count()
+    {
+        if (running_) { alloc_stop(); alloc_start(); }
+        return allocs_;
+    }
+
+    // Bytes allocated while the stopwatch was running
+    unsigned long long alloc_bytes()
+    {
+        if (running_) { alloc_stop(); alloc_start(); }
+        return allocbytes_;
+    }
+
+    // Highest number of live bytes while running, relative to the first start after reset
+    long long alloc_peak()
+    {
+        if (running_) { alloc_stop(); alloc_start(); }
+        return allocpeak_;
+    }
+#endif
+
 private:
     std::chrono::time_point<Clock> starttime_;
     Clock::duration elapsed_ = Clock::duration::zero();
@@ -429,7 +586,116 @@ private:
     long long counter_ = 0;
     int fd_ = 0;
 #endif
+#ifdef USE_ALLOC_COUNT
+    // The stopwatches running at the same time must be started and stopped in nested order
+    // (like the one of perftest inside the one of "stopwatch on"), as they share the global peak
+    void alloc_start()
+    {
+        // Peak is tracked from the current live size, so that only the
+        // allocations made while running are visible in alloc_peak().
+        // The peak seen so far by the enclosing stopwatches is put back by alloc_stop()
+        startallocs_ = alloc_counters.count.load(std::memory_order_relaxed);
+        startbytes_ = alloc_counters.bytes.load(std::memory_order_relaxed);
+        long long live = alloc_counters.live.load(std::memory_order_relaxed);
+        savedpeak_ = alloc_counters.peak.exchange(live, std::memory_order_relaxed);
+        // Peak is reported relative to the live size at the first start after reset
+        if (allocfresh_) { baselive_ = live; allocfresh_ = false; }
+    }
+
+    void alloc_stop()
+    {
+        allocs_ += alloc_counters.count.load(std::memory_order_relaxed) - startallocs_;
+        allocbytes_ += alloc_counters.bytes.load(std::memory_order_relaxed) - startbytes_;
+        long long peak = alloc_counters.peak.load(std::memory_order_relaxed);
+        allocpeak_ = std::max(allocpeak_, peak - baselive_);
+        while (savedpeak_ > peak && !alloc_counters.peak.compare_exchange_weak(peak, savedpeak_, std::memory_order_relaxed)) {}
+    }
+
+    unsigned long long startallocs_ = 0;
+    unsigned long long startbytes_ = 0;
+    long long baselive_ = 0;
+    long long savedpeak_ = 0;
+    bool allocfresh_ = true;
+    unsigned long long allocs_ = 0;
+    unsigned long long allocbytes_ = 0;
+    long long allocpeak_ = 0;
+#endif
 };
 
 
+// Yields distinct random coordinates from the area [min.x,max.x) x [min.y,max.y), skipping the
+// excluded ones, in constant memory. The coordinates are the area's cells in the order of a
+// random permutation (a Feistel network, cycle-walked to the size of the area).
+class MainProgram::CoordSampler
+{
+public:
+    template <typename Engine>
+    CoordSampler(Coord min, Coord max, std::unordered_set<Coord, CoordHash> const& exclude_list, Engine& engine)
+        : min_(min), height_(std::abs(max.y - min.y)), exclude_list_(exclude_list)
+    {
+        size_ = static_cast<unsigned long long int>(std::abs(max.x - min.x)) * height_;
+        while ((1ull << (2*halfbits_)) < size_) { ++halfbits_; }
+        halfmask_ = (1ull << halfbits_) - 1;
+        for (auto& key : keys_)
+        {
+            key = engine();
+            key = (key << 32) ^ engine();
+        }
+    }
+
+    // Number of coordinates in the area, including the excluded ones
+    unsigned long long int size() const { return size_; }
+
+    // The index'th coordinate of the permutation (index < size()), the excluded ones are not skipped.
+    // Does not change the state of the sampler, so it can be called from several threads at once.
+    Coord at(unsigned long long int index) const
+    {
+        unsigned long long int cell = index;
+        do { cell = permute(cell); } while (cell >= size_);
+        return {static_cast<int>(min_.x + cell / height_), static_cast<int>(min_.y + cell % height_)};
+    }
+
+    Coord next()
+    {
+        while (index_ < size_)
+        {
+            Coord coord = at(index_++);
+            if (exclude_list_.find(coord) == exclude_list_.end())
+            {
+                return coord;
+            }
+        }
+        throw NotImplemented("Impossible to create such number of unique coordinates within perimeters");
+    }
+
+private:
+    unsigned long long int permute(unsigned long long int value) const
+    {
+        unsigned long long int left = value >> halfbits_;
+        unsigned long long int right = value & halfmask_;
+        for (auto key : keys_)
+        {
+            // splitmix64 finalizer as the round function
+            unsigned long long int mix = right ^ key;
+            mix = (mix ^ (mix >> 30)) * 0xbf58476d1ce4e5b9ull;
+            mix = (mix ^ (mix >> 27)) * 0x94d049bb133111ebull;
+            mix ^= mix >> 31;
+
+            unsigned long long int newright = left ^ (mix & halfmask_);
+            left = right;
+            right = newright;
+        }
+        return (left << halfbits_) | right;
+    }
+
+    Coord min_;
+    unsigned long long int height_;
+    std::unordered_set<Coord, CoordHash> const& exclude_list_;
+    unsigned long long int size_ = 0;
+    unsigned long long int index_ = 0;
+    unsigned int halfbits_ = 1;
+    unsigned long long int halfmask_ = 0;
+    std::array<unsigned long long int, 4> keys_;
+};
+
 #endif // MAINPROGRAM_HH
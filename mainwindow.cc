@@ -21,6 +21,9 @@
 #include <QPen>
 #include <QGraphicsItem>
 #include <QVariant>
+#include <QScrollBar>
+#include <QThread>
+#include <QTimer>
 
 #include <string>
 using std::string;
@@ -35,13 +38,19 @@ using std::ostringstream;
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <numeric>
+#include <iterator>
 #include <utility>
 #include <tuple>
+#include <cmath>
+#include <limits>
 
 #include <cassert>
 
 #include "mainwindow.hh"
 #include "ui_mainwindow.h"
+
+#include "tracing.hh"
 #if __has_include("worldmap/worldmap.hh")
 #include "worldmap/worldmap.hh"
 #endif
@@ -100,11 +109,17 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(gscene_, &QGraphicsScene::selectionChanged, this, &MainWindow::scene_selection_change);
 
     // Zoom slider changes graphics view scale
-    connect(ui->zoom_plus, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->scale(1.1, 1.1); });
-    connect(ui->zoom_minus, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->scale(1/1.1, 1/1.1); });
-    connect(ui->zoom_1, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->resetTransform(); });
+    connect(ui->zoom_plus, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->scale(1.1, 1.1); this->request_view_update(); });
+    connect(ui->zoom_minus, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->scale(1/1.1, 1/1.1); this->request_view_update(); });
+    connect(ui->zoom_1, &QToolButton::clicked, this, [this]{ this->ui->graphics_view->resetTransform(); this->request_view_update(); });
     connect(ui->zoom_fit, &QToolButton::clicked, this, &MainWindow::fit_view);
 
+    // Only the visible items are drawn, so scrolling and resizing the view updates it
+    connect(ui->graphics_view->horizontalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::request_view_update);
+    connect(ui->graphics_view->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::request_view_update);
+    connect(ui->graphics_view->horizontalScrollBar(), &QScrollBar::rangeChanged, this, &MainWindow::request_view_update);
+    connect(ui->graphics_view->verticalScrollBar(), &QScrollBar::rangeChanged, this, &MainWindow::request_view_update);
+
     // Changing checkboxes updates view
     connect(ui->affiliations_checkbox, &QCheckBox::clicked, this, &MainWindow::update_view);
     connect(ui->affiliationnames_checkbox, &QCheckBox::clicked, this, &MainWindow::update_view);
@@ -140,19 +155,56 @@ MainWindow::MainWindow(QWidget *parent) :
 #endif
 
     clear_input_line();
+
+    // Clicks on the scene may record trace events in this thread too
+    trace_thread_name("main");
+    worker_ = std::thread(&MainWindow::worker_loop, this);
 }
 
 MainWindow::~MainWindow()
 {
+    // A running command is asked to stop, and has to finish before the data structures are destroyed
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex_);
+        worker_quit_ = true;
+    }
+    stop_pressed_ = true;
+    worker_wakeup_.notify_one();
+    worker_.join();
     delete ui;
 }
 
+namespace
+{
+// When more affiliations than this are in view, nearby affiliations are drawn as clusters
+std::size_t const MAX_DRAWN_AFFILIATIONS = 2000;
+// Approximate width of the area on the screen that is combined into one cluster, in pixels
+double const CLUSTER_PIXELS = 48;
+// Items this close to the edge of the view are drawn too, so that partly visible dots and labels are shown
+double const VIEW_MARGIN_PIXELS = 200;
+
+// NO_VALUE is excluded, so that affiliations with erroneous coordinates are never in view
+int clamp_to_int(double value)
+{
+    double low = std::numeric_limits<int>::min() + 1;
+    double high = std::numeric_limits<int>::max();
+    return static_cast<int>(std::max(low, std::min(high, value)));
+}
+}
+
 void MainWindow::update_view()
 {
+    // The data structures are in use by the running command, the view is updated when it finishes
+    if (command_running_)
+    {
+        view_update_pending_ = true;
+        return;
+    }
+    view_update_pending_ = false;
+
     std::unordered_set<std::string> errorset;
     try
     {
-        gscene_->clear();
         auto pointscale = ui->pointscale->value();
         auto fontscale = ui->fontscale->value();
 
@@ -180,23 +232,107 @@ void MainWindow::update_view()
             assert(!"Unhandled result type in update_view()!");
         }
 
-        auto affiliations = mainprg_.ds_.get_all_affiliations();
-        if (affiliations.size() == 1 && affiliations.front() == NO_AFFILIATION)
+        // The label prefix of an affiliation in the result, only shown if there are several of them
+        auto result_prefix = [&result_affiliations](auto const& id, string& prefix){
+            auto res_place = result_affiliations.find(id);
+            if (res_place == result_affiliations.end()) { return false; }
+            prefix = result_affiliations.size() > 1 ? res_place->second : string();
+            return true;
+        };
+
+        // Visible part of the scene in affiliation coordinates (the scene is scaled by 20 and y grows upwards),
+        // widened by the margin
+        auto view = ui->graphics_view;
+        QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+        double pixels_per_unit = 20*std::abs(view->transform().m11());
+        if (pixels_per_unit <= 0) { pixels_per_unit = 20; }
+        double margin = VIEW_MARGIN_PIXELS/pixels_per_unit;
+        Coord view_min = {clamp_to_int(std::floor(visible.left()/20 - margin)), clamp_to_int(std::floor(-visible.bottom()/20 - margin))};
+        Coord view_max = {clamp_to_int(std::ceil(visible.right()/20 + margin)), clamp_to_int(std::ceil(-visible.top()/20 + margin))};
+
+        auto visible_affiliations = mainprg_.ds_.get_affiliations_in_box(view_min, view_max);
+        if (std::find(visible_affiliations.begin(), visible_affiliations.end(), NO_AFFILIATION) != visible_affiliations.end())
         {
-            errorset.insert("get_all_affiliations() returned error {NO_AFFILIATION}");
+            errorset.insert("get_affiliations_in_box() returned error NO_AFFILIATION");
+            visible_affiliations.clear(); // Clear the affiliations so that no more errors are caused by NO_AFFILIATION
         }
+        bool clustered = visible_affiliations.size() > MAX_DRAWN_AFFILIATIONS;
+
+        // Everything is drawn again if the changes since the previous update aren't known or the settings have changed,
+        // otherwise only the changed affiliations are
+        auto changes = mainprg_.ds_.get_affiliation_changes(drawn_version_);
+        bool names = ui->affiliationnames_checkbox->isChecked();
+        bool redraw_all = !drawn_valid_ || !changes.complete || pointscale != drawn_pointscale_
+                          || fontscale != drawn_fontscale_ || names != drawn_names_;
+        drawn_valid_ = true;
+        drawn_version_ = changes.version;
+        drawn_pointscale_ = pointscale;
+        drawn_fontscale_ = fontscale;
+        drawn_names_ = names;
+
+        auto delete_items = [](std::vector<QGraphicsItem*>& items){
+            for (auto item : items) { delete item; }
+            items.clear();
+        };
+        delete_items(cluster_items_);
+
+        auto erase_affiliation_item = [this](AffiliationID const& id){
+            auto item = affiliation_items_.find(id);
+            if (item != affiliation_items_.end())
+            {
+                delete item->second;
+                affiliation_items_.erase(item);
+            }
+            drawn_results_.erase(id);
+        };
 
-        if (ui->affiliations_checkbox->isChecked())
+        if (redraw_all || clustered || !ui->affiliations_checkbox->isChecked())
+        {
+            for (auto& item : affiliation_items_) { delete item.second; }
+            affiliation_items_.clear();
+            drawn_results_.clear();
+        }
+        else
         {
-            auto affiliations = mainprg_.ds_.get_all_affiliations();
-            if (affiliations.size() == 1 && affiliations.front() == NO_AFFILIATION)
+            for (auto& id : changes.changed) { erase_affiliation_item(id); }
+
+            // Affiliations whose highlighting has changed
+            std::vector<AffiliationID> highlight_changed;
+            for (auto& drawn : drawn_results_)
             {
-                errorset.insert("Error from GUI: get_all_affiliations() returned error {NO_AFFILIATION}");
-                affiliations.clear(); // Clear the affiliations so that no more errors are caused by NO_AFFILIATION
+                string prefix;
+                if (!result_prefix(drawn.first, prefix) || prefix != drawn.second) { highlight_changed.push_back(drawn.first); }
             }
+            for (auto& result : result_affiliations)
+            {
+                if (drawn_results_.find(result.first) == drawn_results_.end()) { highlight_changed.push_back(result.first); }
+            }
+            for (auto& id : highlight_changed) { erase_affiliation_item(id); }
 
-            for (auto& affiliationid : affiliations)
+            // Affiliations that have moved out of view
+            std::unordered_set<AffiliationID> visible_set(visible_affiliations.begin(), visible_affiliations.end());
+            for (auto item = affiliation_items_.begin(); item != affiliation_items_.end(); )
             {
+                if (visible_set.find(item->first) == visible_set.end())
+                {
+                    delete item->second;
+                    drawn_results_.erase(item->first);
+                    item = affiliation_items_.erase(item);
+                }
+                else
+                {
+                    ++item;
+                }
+            }
+        }
+
+        if (ui->affiliations_checkbox->isChecked() && !clustered)
+        {
+            for (auto& affiliationid : visible_affiliations)
+            {
+                // Still up to date from a previous update
+                if (affiliation_items_.find(affiliationid) != affiliation_items_.end()) { continue; }
+
                 QColor affiliationcolor = Qt::gray;
                 QColor namecolor = Qt::cyan;
                 QColor affiliationborder = Qt::gray;
@@ -204,88 +340,84 @@ void MainWindow::update_view()
 
                 try
                 {
-                    if (affiliationid != NO_AFFILIATION)
+                    auto xy = mainprg_.ds_.get_affiliation_coord(affiliationid);
+                    auto [x,y] = xy;
+                    if (x == NO_VALUE || y == NO_VALUE)
                     {
-                        auto xy = mainprg_.ds_.get_affiliation_coord(affiliationid);
-                        auto [x,y] = xy;
-                        if (x == NO_VALUE || y == NO_VALUE)
-                        {
-                            errorset.insert("get_affiliation_coordinates() returned error NO_COORD/NO_VALUE");
-                        }
+                        errorset.insert("get_affiliation_coordinates() returned error NO_COORD/NO_VALUE");
+                    }
 
-                        if (x == NO_VALUE || y == NO_VALUE)
-                        {
-                            x = 0; y = 0;
-                            affiliationcolor = Qt::magenta;
-                            namecolor = Qt::magenta;
-                            affiliationzvalue = 30;
-                        }
+                    if (x == NO_VALUE || y == NO_VALUE)
+                    {
+                        x = 0; y = 0;
+                        affiliationcolor = Qt::magenta;
+                        namecolor = Qt::magenta;
+                        affiliationzvalue = 30;
+                    }
 
-                        string prefix;
-                        auto res_place = result_affiliations.find(affiliationid);
-                        if (res_place != result_affiliations.end())
-                        {
-                            if (result_affiliations.size() > 1) { prefix = res_place->second; }
-                            namecolor = Qt::red;
-                            affiliationborder = Qt::red;
-                            affiliationzvalue = 2;
-                        }
+                    string prefix;
+                    bool is_result = result_prefix(affiliationid, prefix);
+                    if (is_result)
+                    {
+                        namecolor = Qt::red;
+                        affiliationborder = Qt::red;
+                        affiliationzvalue = 2;
+                    }
 
-                        if (ui->affiliations_checkbox->isChecked())
+                    auto groupitem = gscene_->createItemGroup({});
+                    groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
+                    groupitem->setData(0, QVariant::fromValue(affiliationid));
+
+                    QPen placepen(affiliationborder);
+                    placepen.setWidth(0); // Cosmetic pen
+                    double publication_scale = std::max(1.0,1.0+std::log10(mainprg_.ds_.get_publications(affiliationid).size()));
+                    auto dotitem = gscene_->addEllipse(-4*pointscale*publication_scale, -4*pointscale*publication_scale, 8*pointscale*publication_scale, 8*pointscale*publication_scale,
+                                                       placepen, QBrush(affiliationcolor));
+                    dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+                    groupitem->addToGroup(dotitem);
+
+                    // Draw place names
+                    string label = prefix;
+                    if (names)
+                    {
+                        try
                         {
-                            auto groupitem = gscene_->createItemGroup({});
-                            groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
-                            groupitem->setData(0, QVariant::fromValue(affiliationid));
-
-                            QPen placepen(affiliationborder);
-                            placepen.setWidth(0); // Cosmetic pen
-                            double publication_scale = std::max(1.0,1.0+std::log10(mainprg_.ds_.get_publications(affiliationid).size()));
-                            auto dotitem = gscene_->addEllipse(-4*pointscale*publication_scale, -4*pointscale*publication_scale, 8*pointscale*publication_scale, 8*pointscale*publication_scale,
-                                                               placepen, QBrush(affiliationcolor));
-                            dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
-                            groupitem->addToGroup(dotitem);
-
-                            // Draw place names
-                            string label = prefix;
-                            if (ui->affiliationnames_checkbox->isChecked())
-                            {
-                                try
-                                {
-                                    auto name = mainprg_.ds_.get_affiliation_name(affiliationid);
-                                    if (name == NO_NAME)
-                                    {
-                                        errorset.insert("get_affiliation_name() returned error NO_NAME");
-                                    }
-
-                                    label += name;
-                                }
-                                catch (NotImplemented const& e)
-                                {
-                                    errorset.insert(std::string("NotImplemented while updating graphics: ") + e.what());
-                                    std::cerr << std::endl << "NotImplemented while updating graphics: " << e.what() << std::endl;
-                                }
-                            }
-
-                            if (!label.empty())
+                            auto name = mainprg_.ds_.get_affiliation_name(affiliationid);
+                            if (name == NO_NAME)
                             {
-                                // Create extra item group to be able to set ItemIgnoresTransformations on the correct level (addSimpleText does not allow
-                                // setting initial coordinates in item coordinates
-                                auto textgroupitem = gscene_->createItemGroup({});
-                                auto textitem = gscene_->addSimpleText(QString::fromStdString(label));
-                                auto font = textitem->font();
-                                font.setPointSizeF(font.pointSizeF()*fontscale);
-                                textitem->setFont(font);
-                                textitem->setBrush(QBrush(namecolor));
-                                textitem->setPos(-textitem->boundingRect().width()/2, -4*pointscale - textitem->boundingRect().height());
-                                textgroupitem->addToGroup(textitem);
-                                textgroupitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
-                                groupitem->addToGroup(textgroupitem);
+                                errorset.insert("get_affiliation_name() returned error NO_NAME");
                             }
 
-                            groupitem->setPos(20*x, -20*y);
-                            groupitem->setZValue(affiliationzvalue);
+                            label += name;
+                        }
+                        catch (NotImplemented const& e)
+                        {
+                            errorset.insert(std::string("NotImplemented while updating graphics: ") + e.what());
+                            std::cerr << std::endl << "NotImplemented while updating graphics: " << e.what() << std::endl;
                         }
                     }
+
+                    if (!label.empty())
+                    {
+                        // Create extra item group to be able to set ItemIgnoresTransformations on the correct level (addSimpleText does not allow
+                        // setting initial coordinates in item coordinates
+                        auto textgroupitem = gscene_->createItemGroup({});
+                        auto textitem = gscene_->addSimpleText(QString::fromStdString(label));
+                        auto font = textitem->font();
+                        font.setPointSizeF(font.pointSizeF()*fontscale);
+                        textitem->setFont(font);
+                        textitem->setBrush(QBrush(namecolor));
+                        textitem->setPos(-textitem->boundingRect().width()/2, -4*pointscale - textitem->boundingRect().height());
+                        textgroupitem->addToGroup(textitem);
+                        textgroupitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+                        groupitem->addToGroup(textgroupitem);
+                    }
+
+                    groupitem->setPos(20*x, -20*y);
+                    groupitem->setZValue(affiliationzvalue);
+
+                    affiliation_items_[affiliationid] = groupitem;
+                    if (is_result) { drawn_results_[affiliationid] = prefix; }
                 }
                 catch (NotImplemented const& e)
                 {
@@ -294,75 +426,195 @@ void MainWindow::update_view()
                 }
             }
         }
-        if (ui->publications_checkbox->isChecked())
+        else if (ui->affiliations_checkbox->isChecked())
         {
-            try
+            // Too many affiliations in view to draw them one by one, so the affiliations in each square of about
+            // CLUSTER_PIXELS on the screen are drawn as one marker at their average coordinates
+            struct Cluster
+            {
+                std::size_t count = 0;
+                double xsum = 0;
+                double ysum = 0;
+                bool has_result = false;
+            };
+            double cluster_size = std::max(1.0, CLUSTER_PIXELS/pixels_per_unit);
+            std::map<std::pair<long long int, long long int>, Cluster> clusters;
+            for (auto& affiliationid : visible_affiliations)
             {
-                auto publicationids = mainprg_.ds_.all_publications();
-                if (publicationids.size() == 1 && publicationids.front() == NO_PUBLICATION)
+                auto [x,y] = mainprg_.ds_.get_affiliation_coord(affiliationid);
+                if (x == NO_VALUE || y == NO_VALUE)
                 {
-                    errorset.insert("all_publications() returned error {NO_PUBLICATION}");
+                    errorset.insert("get_affiliation_coordinates() returned error NO_COORD/NO_VALUE");
+                    continue;
                 }
+                auto& cluster = clusters[{static_cast<long long int>(std::floor(x/cluster_size)),
+                                          static_cast<long long int>(std::floor(y/cluster_size))}];
+                ++cluster.count;
+                cluster.xsum += x;
+                cluster.ysum += y;
+                cluster.has_result = cluster.has_result || result_affiliations.find(affiliationid) != result_affiliations.end();
+            }
 
-                for (auto publicationid : publicationids)
-                {
-                    QColor publicationcolor = Qt::blue;
-                    int publicationzvalue = -3;
+            for (auto& [cell, cluster] : clusters)
+            {
+                QColor clusterborder = cluster.has_result ? Qt::red : Qt::gray;
+                QColor countcolor = cluster.has_result ? Qt::red : Qt::cyan;
+                Coord center = {clamp_to_int(std::round(cluster.xsum/cluster.count)), clamp_to_int(std::round(cluster.ysum/cluster.count))};
+
+                // Clicking a cluster prints its coordinates
+                auto groupitem = gscene_->createItemGroup({});
+                groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
+                groupitem->setData(0, QVariant::fromValue(center));
+
+                QPen clusterpen(clusterborder);
+                clusterpen.setWidth(0); // Cosmetic pen
+                double cluster_scale = 1.0+std::log10(cluster.count);
+                auto dotitem = gscene_->addEllipse(-4*pointscale*cluster_scale, -4*pointscale*cluster_scale, 8*pointscale*cluster_scale, 8*pointscale*cluster_scale,
+                                                   clusterpen, QBrush(Qt::darkGray));
+                dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+                groupitem->addToGroup(dotitem);
+
+                // Number of affiliations in the cluster, centered on the marker
+                auto textgroupitem = gscene_->createItemGroup({});
+                auto textitem = gscene_->addSimpleText(QString::number(static_cast<qulonglong>(cluster.count)));
+                auto font = textitem->font();
+                font.setPointSizeF(font.pointSizeF()*fontscale);
+                textitem->setFont(font);
+                textitem->setBrush(QBrush(countcolor));
+                textitem->setPos(-textitem->boundingRect().width()/2, -textitem->boundingRect().height()/2);
+                textgroupitem->addToGroup(textitem);
+                textgroupitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+                groupitem->addToGroup(textgroupitem);
+
+                groupitem->setPos(20.0*center.x, -20.0*center.y);
+                groupitem->setZValue(cluster.has_result ? 2 : 1);
+                cluster_items_.push_back(groupitem);
+            }
+        }
 
-                    try
+        // The publications of the visible affiliations are drawn, or only the ones in the result when the affiliations
+        // are clustered. The lines of the other publications would be too many to draw and mostly out of view.
+        std::unordered_set<PublicationID> drawn_publications;
+        if (ui->publications_checkbox->isChecked())
+        {
+            for (auto& result : result_publications) { drawn_publications.insert(result.first); }
+            if (!clustered)
+            {
+                try
+                {
+                    for (auto& affiliationid : visible_affiliations)
                     {
-                        if (publicationid != NO_PUBLICATION)
+                        auto publicationids = mainprg_.ds_.get_publications(affiliationid);
+                        if (publicationids.size() == 1 && publicationids.front() == NO_PUBLICATION)
                         {
-                            if (result_publications.find(publicationid) != result_publications.end())
-                            {
-                                publicationcolor = Qt::green;
-                                publicationzvalue = -2;
-                            }
-                            auto affiliations = mainprg_.ds_.get_affiliations(publicationid);
-                            if (affiliations.size() == 0) {
-                                continue;
-                            }
-                            if (std::find(affiliations.begin(), affiliations.end(), NO_AFFILIATION) != affiliations.end())
-                            {
-                                errorset.insert("get_affiliations() returned error NO_AFFILIATION");
-                                continue;
-                            }
-                            std::vector<Coord> aff_coords = {};
-                            aff_coords.reserve(affiliations.size());
-                            std::transform(affiliations.begin(),affiliations.end(),std::back_inserter(aff_coords),[this](auto id){return mainprg_.ds_.get_affiliation_coord(id);});
-                            if (std::find(aff_coords.begin(),aff_coords.end(),NO_COORD) != aff_coords.end())
-                            {
-                                errorset.insert("get_affiliations() returned error NO_AFFILIATION");
-                                continue;
-                            }
-                            auto pen = QPen(publicationcolor);
-                            pen.setWidth(0); // "Cosmetic" pen
-                            Coord centercoord = NO_COORD;
-                            long long int x = std::accumulate(aff_coords.begin(), aff_coords.end(), 0, [](auto& coord1, auto& coord2){return coord1 + coord2.x;});
-                            x /= aff_coords.size();
-                            long long int y = std::accumulate(aff_coords.begin(), aff_coords.end(), 0, [](auto& coord1, auto& coord2){return coord1 + coord2.y;});
-                            y /= aff_coords.size();
-                            centercoord.x = x;
-                            centercoord.y = y;
-                            for (auto& coord : aff_coords)
-                            {
-                                if (centercoord != NO_COORD)
-                                {
-                                    QLineF line(QPointF(20*centercoord.x, -20*centercoord.y), QPointF(20*coord.x, -20*coord.y));
-                                    auto lineitem = gscene_->addLine(line, pen);
-                                    lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
-                                    lineitem->setData(0, QVariant::fromValue(publicationid));
-                                    lineitem->setZValue(publicationzvalue);
-                                }
-                            }
-
+                            errorset.insert("get_publications() returned error {NO_PUBLICATION}");
+                            continue;
                         }
+                        drawn_publications.insert(publicationids.begin(), publicationids.end());
                     }
-                    catch (NotImplemented const& e)
-                    {
-                        errorset.insert(std::string("NotImplemented while updating graphics: ") + e.what());
-                        std::cerr << std::endl << "NotImplemented while updating graphics: " << e.what() << std::endl;
-                    }
+                }
+                catch (NotImplemented const& e)
+                {
+                    errorset.insert(std::string("NotImplemented while updating graphics: ") + e.what());
+                    std::cerr << std::endl << "NotImplemented while updating graphics: " << e.what() << std::endl;
+                }
+            }
+        }
+
+        // Publications whose lines may have changed: the ones drawn to a changed affiliation
+        // and the ones a changed affiliation now belongs to
+        std::unordered_set<AffiliationID> changed_affiliations(changes.changed.begin(), changes.changed.end());
+        std::unordered_set<PublicationID> changed_publications;
+        if (!redraw_all)
+        {
+            try
+            {
+                for (auto& affiliationid : changed_affiliations)
+                {
+                    auto publicationids = mainprg_.ds_.get_publications(affiliationid);
+                    if (publicationids.size() == 1 && publicationids.front() == NO_PUBLICATION) { continue; }
+                    changed_publications.insert(publicationids.begin(), publicationids.end());
+                }
+            }
+            catch (NotImplemented const&)
+            {
+                redraw_all = true; // Already reported above
+            }
+        }
+
+        for (auto drawn = publication_items_.begin(); drawn != publication_items_.end(); )
+        {
+            bool is_result = result_publications.find(drawn->first) != result_publications.end();
+            bool changed = redraw_all || drawn->second.is_result != is_result
+                           || drawn_publications.find(drawn->first) == drawn_publications.end()
+                           || changed_publications.find(drawn->first) != changed_publications.end()
+                           || std::any_of(drawn->second.affiliations.begin(), drawn->second.affiliations.end(),
+                                          [&changed_affiliations](auto& id){ return changed_affiliations.find(id) != changed_affiliations.end(); });
+            if (changed)
+            {
+                for (auto item : drawn->second.lines) { delete item; }
+                drawn = publication_items_.erase(drawn);
+            }
+            else
+            {
+                ++drawn;
+            }
+        }
+
+        for (auto publicationid : drawn_publications)
+        {
+            // Still up to date from a previous update
+            if (publicationid == NO_PUBLICATION || publication_items_.find(publicationid) != publication_items_.end()) { continue; }
+
+            QColor publicationcolor = Qt::blue;
+            int publicationzvalue = -3;
+
+            try
+            {
+                bool is_result = result_publications.find(publicationid) != result_publications.end();
+                if (is_result)
+                {
+                    publicationcolor = Qt::green;
+                    publicationzvalue = -2;
+                }
+                auto affiliations = mainprg_.ds_.get_affiliations(publicationid);
+                if (affiliations.size() == 0) {
+                    continue;
+                }
+                if (std::find(affiliations.begin(), affiliations.end(), NO_AFFILIATION) != affiliations.end())
+                {
+                    errorset.insert("get_affiliations() returned error NO_AFFILIATION");
+                    continue;
+                }
+                std::vector<Coord> aff_coords = {};
+                aff_coords.reserve(affiliations.size());
+                std::transform(affiliations.begin(),affiliations.end(),std::back_inserter(aff_coords),[this](auto id){return mainprg_.ds_.get_affiliation_coord(id);});
+                if (std::find(aff_coords.begin(),aff_coords.end(),NO_COORD) != aff_coords.end())
+                {
+                    errorset.insert("get_affiliations() returned error NO_AFFILIATION");
+                    continue;
+                }
+                auto pen = QPen(publicationcolor);
+                pen.setWidth(0); // "Cosmetic" pen
+                Coord centercoord = NO_COORD;
+                long long int x = std::accumulate(aff_coords.begin(), aff_coords.end(), 0, [](auto& coord1, auto& coord2){return coord1 + coord2.x;});
+                x /= aff_coords.size();
+                long long int y = std::accumulate(aff_coords.begin(), aff_coords.end(), 0, [](auto& coord1, auto& coord2){return coord1 + coord2.y;});
+                y /= aff_coords.size();
+                centercoord.x = x;
+                centercoord.y = y;
+
+                auto& drawn = publication_items_[publicationid];
+                drawn.affiliations = std::move(affiliations);
+                drawn.is_result = is_result;
+                for (auto& coord : aff_coords)
+                {
+                    QLineF line(QPointF(20*centercoord.x, -20*centercoord.y), QPointF(20*coord.x, -20*coord.y));
+                    auto lineitem = gscene_->addLine(line, pen);
+                    lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
+                    lineitem->setData(0, QVariant::fromValue(publicationid));
+                    lineitem->setZValue(publicationzvalue);
+                    drawn.lines.push_back(lineitem);
                 }
             }
             catch (NotImplemented const& e)
@@ -374,7 +626,8 @@ void MainWindow::update_view()
 
 
 #ifdef WORLDMAP_HH
-        if (ui->world_map_checkbox->isChecked()) {
+        // The map never changes, so its polygons are created only once
+        if (ui->world_map_checkbox->isChecked() && worldmap_items_.empty()) {
             auto pen = QPen(Qt::red);
             pen.setWidth(0); // "Cosmetic" pen
             for (auto& polygon : worldmap::POLYGONS) {
@@ -387,9 +640,27 @@ void MainWindow::update_view()
                 QPolygonF qpolygon(list_of_points);
                 auto polygonitem = gscene_->addPolygon(qpolygon,pen);
                 polygonitem->setZValue(0);
+                worldmap_items_.push_back(polygonitem);
             }
         }
+        for (auto item : worldmap_items_) { item->setVisible(ui->world_map_checkbox->isChecked()); }
 #endif
+
+        // Only the items in view are in the scene, so the scrollable area is set from the bounds of all the affiliations
+        QRectF scene_rect;
+        auto [bounds_min, bounds_max] = mainprg_.ds_.get_affiliation_bounds();
+        if (bounds_min != NO_COORD && bounds_max != NO_COORD)
+        {
+            scene_rect = QRectF(QPointF(20.0*bounds_min.x, -20.0*bounds_max.y), QPointF(20.0*bounds_max.x, -20.0*bounds_min.y)).adjusted(-20, -20, 20, 20);
+        }
+        for (auto item : worldmap_items_)
+        {
+            if (item->isVisible()) { scene_rect = scene_rect.united(item->sceneBoundingRect()); }
+        }
+        if (scene_rect != gscene_->sceneRect())
+        {
+            gscene_->setSceneRect(scene_rect);
+        }
     }
     catch (NotImplemented const& e)
     {
@@ -409,18 +680,55 @@ void MainWindow::update_view()
     }
 }
 
+void MainWindow::request_view_update()
+{
+    if (view_update_requested_) { return; }
+    view_update_requested_ = true;
+    QTimer::singleShot(0, this, [this]{
+        view_update_requested_ = false;
+        update_view();
+    });
+}
+
 void MainWindow::output_text(ostringstream& output)
 {
     string outstr = output.str();
+    output.str(""); // Clear the stream, because it has already been output
+    if (outstr.empty()) { return; }
+
+    if (QThread::currentThread() != thread())
+    {
+        // Widgets can only be used by the GUI thread, so the text is queued for it
+        std::lock_guard<std::mutex> lock(pending_output_mutex_);
+        bool posted = !pending_output_.empty();
+        pending_output_ += outstr;
+        if (!posted)
+        {
+            QMetaObject::invokeMethod(this, [this]{ show_pending_output(); output_text_end(); }, Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    show_pending_output(); // Keep the output in order
+    if (outstr.back() == '\n') { outstr.pop_back(); } // Remove trailing newline
+    ui->output->appendPlainText(QString::fromStdString(outstr));
+    ui->output->ensureCursorVisible();
+    ui->output->repaint();
+}
+
+void MainWindow::show_pending_output()
+{
+    string outstr;
+    {
+        std::lock_guard<std::mutex> lock(pending_output_mutex_);
+        outstr.swap(pending_output_);
+    }
     if (!outstr.empty())
     {
         if (outstr.back() == '\n') { outstr.pop_back(); } // Remove trailing newline
         ui->output->appendPlainText(QString::fromStdString(outstr));
         ui->output->ensureCursorVisible();
-        ui->output->repaint();
     }
-
-    output.str(""); // Clear the stream, because it has already been output
 }
 
 void MainWindow::output_text_end()
@@ -432,12 +740,14 @@ void MainWindow::output_text_end()
 
 bool MainWindow::check_stop_pressed() const
 {
-    QCoreApplication::processEvents();
     return stop_pressed_;
 }
 
 void MainWindow::execute_line()
 {
+    // Only one command runs at a time
+    if (command_running_) { return; }
+
     auto line = ui->lineEdit->text();
     clear_input_line();
     ui->output->appendPlainText(QString::fromStdString(MainProgram::PROMPT)+line);
@@ -446,10 +756,41 @@ void MainWindow::execute_line()
     ui->stop_button->setEnabled(true);
     stop_pressed_ = false;
 
-    ostringstream output;
-    bool cont = mainprg_.command_parse_line(line.toStdString(), output);
-    ui->lineEdit->clear();
-    output_text(output);
+    // The command runs on the worker thread so that the window stays responsive, its output is
+    // flushed back through output_text() and the Stop button is polled through check_stop_pressed()
+    command_running_ = true;
+    command_output_.str("");
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex_);
+        worker_line_ = line.toStdString();
+        worker_has_line_ = true;
+    }
+    worker_wakeup_.notify_one();
+}
+
+void MainWindow::worker_loop()
+{
+    trace_thread_name("command worker");
+    std::unique_lock<std::mutex> lock(worker_mutex_);
+    while (true)
+    {
+        worker_wakeup_.wait(lock, [this]{ return worker_has_line_ || worker_quit_; });
+        if (worker_quit_) { return; }
+        std::string line = std::move(worker_line_);
+        worker_has_line_ = false;
+
+        lock.unlock();
+        bool cont = mainprg_.command_parse_line(line, command_output_);
+        QMetaObject::invokeMethod(this, [this, cont]{ command_finished(cont); }, Qt::QueuedConnection);
+        lock.lock();
+    }
+}
+
+void MainWindow::command_finished(bool cont)
+{
+    command_running_ = false;
+
+    output_text(command_output_);
     output_text_end();
 
     ui->stop_button->setEnabled(false);
@@ -458,7 +799,16 @@ void MainWindow::execute_line()
 
     ui->lineEdit->setFocus();
 
-    update_view();
+    // A click during the command is printed now, with the data as the command left it
+    if (selection_pending_)
+    {
+        selection_pending_ = false;
+        scene_selection_change();
+    }
+    if (view_update_pending_ || mainprg_.view_dirty)
+    {
+        update_view();
+    }
 
     if (!cont)
     {
@@ -507,11 +857,21 @@ void MainWindow::clear_input_line()
 
 void MainWindow::fit_view()
 {
-    ui->graphics_view->fitInView(gscene_->itemsBoundingRect(), Qt::KeepAspectRatio);
+    // The scene rect covers all the affiliations, not just the ones currently drawn
+    ui->graphics_view->fitInView(gscene_->sceneRect(), Qt::KeepAspectRatio);
+    request_view_update();
 }
 
 void MainWindow::scene_selection_change()
 {
+    // Printing the clicked item would read the data structures while the running command uses them,
+    // the item stays selected and is printed when the command finishes
+    if (command_running_)
+    {
+        selection_pending_ = true;
+        return;
+    }
+
     auto items = gscene_->selectedItems();
     if (!items.empty())
     {
@@ -14,6 +14,15 @@
 #include <QMainWindow>
 #include <QGraphicsScene>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 namespace Ui {
 class MainWindow;
 }
@@ -27,9 +36,13 @@ public:
     ~MainWindow();
 
     void update_view();
+    // Updates the view once control returns to the event loop, several requests are combined into one update
+    void request_view_update();
+    // Can be called from the worker thread too, then the text is shown once the GUI thread gets to it
     void output_text(std::ostringstream &output);
     void output_text_end();
 
+    // Can be called from any thread
     bool check_stop_pressed() const;
 
 public slots:
@@ -49,9 +62,61 @@ private:
 
     MainProgram mainprg_;
 
-    bool stop_pressed_ = false;
+    // Set by the Stop button, polled by the running command
+    std::atomic<bool> stop_pressed_{false};
+
+    // Runs the command lines one at a time for the lifetime of the window, the data structures aren't
+    // touched by the GUI thread while a command runs
+    std::thread worker_;
+    void worker_loop();
+    // Line given to the worker and whether the worker should exit, protected by worker_mutex_
+    std::mutex worker_mutex_;
+    std::condition_variable worker_wakeup_;
+    std::string worker_line_;
+    bool worker_has_line_ = false;
+    bool worker_quit_ = false;
+
+    // Used by the GUI thread only
+    bool command_running_ = false;
+    std::ostringstream command_output_;
+    void command_finished(bool cont);
+    // View updates and scene clicks that came while a command was running, done by command_finished
+    bool view_update_pending_ = false;
+    bool selection_pending_ = false;
+
+    // Output flushed by the worker thread and not yet shown
+    std::mutex pending_output_mutex_;
+    std::string pending_output_;
+    void show_pending_output();
 
     bool selection_clear_in_progress = false;
+
+    bool view_update_requested_ = false;
+
+    // Items of the affiliations that are drawn one by one, only the visible ones are kept
+    std::unordered_map<AffiliationID, QGraphicsItem*> affiliation_items_;
+    // Result prefix of each drawn affiliation that was highlighted as a result
+    std::unordered_map<AffiliationID, std::string> drawn_results_;
+    // Cluster markers, recreated on every update
+    std::vector<QGraphicsItem*> cluster_items_;
+    // Lines of the drawn publications, the affiliations they were drawn to and whether they were highlighted
+    // as a result. Kept until the publication is no longer drawn or one of its affiliations changes.
+    struct PublicationLines
+    {
+        std::vector<AffiliationID> affiliations;
+        bool is_result = false;
+        std::vector<QGraphicsItem*> lines;
+    };
+    std::unordered_map<PublicationID, PublicationLines> publication_items_;
+    // World map polygons, created once and then only shown or hidden
+    std::vector<QGraphicsItem*> worldmap_items_;
+
+    // Settings and data version the drawn items were created with, a change in the settings redraws everything
+    unsigned long long int drawn_version_ = 0;
+    bool drawn_valid_ = false;
+    double drawn_pointscale_ = 0;
+    double drawn_fontscale_ = 0;
+    bool drawn_names_ = false;
 };
 
 #endif // MAINWINDOW_HH
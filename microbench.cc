@@ -0,0 +1,426 @@
+// Microbench.cc
+//
+// Microbenchmarks for the individual Datastructures operations. Unlike the
+// perftest command, which also times command parsing and random ID generation,
+// every operation here is timed alone against data structures of several sizes,
+// built from inputs that are generated before any timing starts.
+//
+// Usage: microbench [--sizes=1000,10000,100000] [--reps=7] [--warmup=2] [filter]
+// Only the operations whose name contains filter are run.
+
+#include "datastructures.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Operations in one sample are repeated until the sample takes at least this long
+std::chrono::microseconds const MIN_SAMPLE_TIME{2000};
+// Upper limit for the number of operations in one sample
+unsigned int const MAX_BATCH = 1u << 20;
+// Number of fresh elements and query arguments generated for each size
+unsigned int const POOL_SIZE = 1000;
+// Samples further than this many (scaled) median absolute deviations from the median are rejected
+double const OUTLIER_MADS = 3.0;
+
+// Results of the operations are accumulated here, so that the compiler can't optimize the calls away
+volatile std::size_t sink = 0;
+
+// Inputs for one data structure size
+struct Dataset
+{
+    // Contents of the data structure, each publication has 1-3 affiliations
+    // and references a random earlier publication
+    std::vector<AffiliationData> affiliations;
+    std::vector<PublicationData> publications;
+    // Affiliations and publications not in the data structure, for the operations that add them
+    std::vector<AffiliationData> newAffiliations;
+    std::vector<PublicationData> newPublications;
+    // Coordinates not used by any affiliation
+    std::vector<Coord> newCoords;
+    // Distinct random indexes into affiliations and publications, used as query arguments
+    std::vector<unsigned int> affiliationIdx;
+    std::vector<unsigned int> publicationIdx;
+
+    AffiliationData const& affiliation(unsigned int i) const { return affiliations[affiliationIdx[i % affiliationIdx.size()]]; }
+    PublicationData const& publication(unsigned int i) const { return publications[publicationIdx[i % publicationIdx.size()]]; }
+    // Number of distinct arguments, which limits the operations in a sample that changes the data
+    unsigned int pool_size() const { return std::min<unsigned int>(POOL_SIZE, std::min(affiliationIdx.size(), publicationIdx.size())); }
+};
+
+std::string random_name(std::mt19937& gen)
+{
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::string name(8, ' ');
+    for (auto& c : name) { c = static_cast<char>(letter(gen)); }
+    return name;
+}
+
+// Distinct random indexes in [0, size), at most POOL_SIZE of them
+std::vector<unsigned int> random_indexes(unsigned int size, std::mt19937& gen)
+{
+    std::vector<unsigned int> indexes(size);
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::shuffle(indexes.begin(), indexes.end(), gen);
+    indexes.resize(std::min(size, POOL_SIZE));
+    return indexes;
+}
+
+Dataset generate_dataset(unsigned int size, std::mt19937& gen)
+{
+    Dataset data;
+
+    // Coordinates are drawn without replacement from a square with room for all of them
+    unsigned int coordCount = size + 2 * POOL_SIZE;
+    int side = static_cast<int>(std::ceil(std::sqrt(4.0 * coordCount)));
+    std::vector<int> cells(side * side);
+    std::iota(cells.begin(), cells.end(), 0);
+    std::shuffle(cells.begin(), cells.end(), gen);
+    unsigned int nextCell = 0;
+    auto next_coord = [&]() { int cell = cells[nextCell++]; return Coord{cell % side, cell / side}; };
+
+    for (unsigned int i = 0; i < size + POOL_SIZE; ++i) {
+        AffiliationData affiliation{"A" + std::to_string(i), random_name(gen), next_coord()};
+        (i < size ? data.affiliations : data.newAffiliations).push_back(affiliation);
+    }
+    for (unsigned int i = 0; i < POOL_SIZE; ++i) {
+        data.newCoords.push_back(next_coord());
+    }
+
+    std::uniform_int_distribution<int> yearDist(1950, 2023);
+    std::uniform_int_distribution<int> affiliationCount(1, 3);
+    for (unsigned int i = 0; i < size + POOL_SIZE; ++i) {
+        PublicationData publication{1000 + i, random_name(gen), static_cast<Year>(yearDist(gen)), {}};
+        if (size > 0) {
+            for (int j = affiliationCount(gen); j > 0; --j) {
+                auto affiliation = std::uniform_int_distribution<unsigned int>(0, size - 1)(gen);
+                publication.affiliations.push_back(data.affiliations[affiliation].id);
+            }
+        }
+        if (i < size) {
+            if (i > 0) {
+                publication.parent = 1000 + std::uniform_int_distribution<unsigned int>(0, i - 1)(gen);
+            }
+            data.publications.push_back(publication);
+        } else {
+            data.newPublications.push_back(publication);
+        }
+    }
+
+    data.affiliationIdx = random_indexes(size, gen);
+    data.publicationIdx = random_indexes(size, gen);
+    return data;
+}
+
+// Fills the data structure with the contents of the dataset. Publications are added without
+// affiliations and the affiliations are added one by one, so that both directions get linked.
+void build(Datastructures& ds, Dataset const& data)
+{
+    ds.add_affiliations(data.affiliations);
+    std::vector<PublicationData> publications = data.publications;
+    for (auto& publication : publications) {
+        publication.affiliations.clear();
+    }
+    ds.add_publications(publications);
+    for (auto const& publication : data.publications) {
+        for (auto const& affiliation : publication.affiliations) {
+            ds.add_affiliation_to_publication(affiliation, publication.id);
+        }
+    }
+}
+
+struct Benchmark
+{
+    std::string name;
+    // Runs the operation with the i'th argument
+    std::function<void(Datastructures&, Dataset const&, unsigned int)> op;
+    // True if the operation changes the data structure. Then the data structure is
+    // rebuilt for every sample and a sample runs the operation once for every argument.
+    bool mutating = false;
+    // Additional untimed preparation after the data structure has been built
+    std::function<void(Datastructures&, Dataset const&)> prepare = nullptr;
+    // Upper limit for the number of operations in one sample
+    unsigned int maxBatch = MAX_BATCH;
+};
+
+std::vector<Benchmark> const& benchmarks()
+{
+    static std::vector<Benchmark> const list = {
+        {"get_affiliation_count", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.get_affiliation_count(); }},
+        {"get_all_affiliations", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.get_all_affiliations().size(); }},
+        {"add_affiliation", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            auto const& affiliation = data.newAffiliations[i];
+            sink += ds.add_affiliation(affiliation.id, affiliation.name, affiliation.xy); }, true},
+        {"get_affiliation_name", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliation_name(data.affiliation(i).id).size(); }},
+        {"get_affiliation_coord", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliation_coord(data.affiliation(i).id).x; }},
+        {"get_affiliations_alphabetically", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.get_affiliations_alphabetically().size(); }},
+        {"get_affiliations_distance_increasing", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.get_affiliations_distance_increasing().size(); }},
+        {"find_affiliation_with_coord", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.find_affiliation_with_coord(data.affiliation(i).xy).size(); }},
+        {"change_affiliation_coord", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.change_affiliation_coord(data.affiliation(i).id, data.newCoords[i]); }, true},
+        {"add_publication", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            auto const& publication = data.newPublications[i];
+            sink += ds.add_publication(publication.id, publication.name, publication.year, publication.affiliations); }, true},
+        {"all_publications", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.all_publications().size(); }},
+        {"get_publication_name", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_publication_name(data.publication(i).id).size(); }},
+        {"get_publication_year", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_publication_year(data.publication(i).id); }},
+        {"get_affiliations", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliations(data.publication(i).id).size(); }},
+        {"add_reference", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.add_reference(data.newPublications[i].id, data.publication(i).id); }, true,
+            [](Datastructures& ds, Dataset const& data) { ds.add_publications(data.newPublications); }},
+        {"get_direct_references", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_direct_references(data.publication(i).id).size(); }},
+        {"add_affiliation_to_publication", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.add_affiliation_to_publication(data.affiliation(i).id, data.publication(i).id); }, true},
+        {"get_publications", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_publications(data.affiliation(i).id).size(); }},
+        {"get_parent", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_parent(data.publication(i).id); }},
+        {"get_publications_after", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_publications_after(data.affiliation(i).id, 1990).size(); }},
+        {"get_referenced_by_chain", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_referenced_by_chain(data.publication(i).id).size(); }},
+        {"get_all_references", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_all_references(data.publication(i).id).size(); }},
+        {"get_affiliations_closest_to", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliations_closest_to(data.newCoords[i % POOL_SIZE]).size(); }},
+        {"get_affiliations_nearest", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliations_nearest(data.newCoords[i % POOL_SIZE], 10).size(); }},
+        {"get_affiliations_within", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_affiliations_within(data.newCoords[i % POOL_SIZE], 20).size(); }},
+        {"get_affiliations_in_box", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            Coord min = data.newCoords[i % POOL_SIZE];
+            sink += ds.get_affiliations_in_box(min, {min.x + 20, min.y + 20}).size(); }},
+        {"get_collaborators", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_collaborators(data.affiliation(i).id).size(); }},
+        {"get_collaboration_path", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_collaboration_path(data.affiliation(i).id, data.affiliation(i + 1).id).size(); }},
+        {"get_collaboration_path_by_distance", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_collaboration_path_by_distance(data.affiliation(i).id, data.affiliation(i + 1).id).size(); }},
+        {"get_citation_count", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_citation_count(data.publication(i).id); }},
+        {"get_most_cited", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.get_most_cited(10).size(); }},
+        {"get_publications_between", [](Datastructures& ds, Dataset const&, unsigned int i) {
+            Year first = 1950 + i % 50;
+            sink += ds.get_publications_between(first, first + 10).size(); }},
+        {"count_publications_between", [](Datastructures& ds, Dataset const&, unsigned int i) {
+            Year first = 1950 + i % 50;
+            sink += ds.count_publications_between(first, first + 10); }},
+        {"find_affiliations_by_prefix", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.find_affiliations_by_prefix(data.affiliation(i).name.substr(0, 2), 10).size(); }},
+        {"search_publications", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.search_publications(data.publication(i).name).size(); }},
+        {"find_similar_affiliations", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.find_similar_affiliations(data.affiliation(i).name, 10).size(); }},
+        {"get_common_publications", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_common_publications(data.affiliation(i).id, data.affiliation(i + 1).id).size(); }},
+        {"get_common_publications_of", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_common_publications_of({data.affiliation(i).id, data.affiliation(i + 1).id,
+                                                   data.affiliation(i + 2).id}).size(); }},
+        {"get_similar_affiliations", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_similar_affiliations(data.affiliation(i).id, 10).size(); }},
+        {"remove_affiliation", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.remove_affiliation(data.affiliation(i).id); }, true},
+        {"get_closest_common_parent", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.get_closest_common_parent(data.publication(i).id, data.publication(i + 1).id); }},
+        {"remove_publication", [](Datastructures& ds, Dataset const& data, unsigned int i) {
+            sink += ds.remove_publication(data.publication(i).id); }, true},
+        {"add_affiliations", [](Datastructures& ds, Dataset const& data, unsigned int) {
+            sink += ds.add_affiliations(data.newAffiliations); }, true, nullptr, 1},
+        {"add_publications", [](Datastructures& ds, Dataset const& data, unsigned int) {
+            sink += ds.add_publications(data.newPublications); }, true, nullptr, 1},
+        {"memory_usage", [](Datastructures& ds, Dataset const&, unsigned int) {
+            sink += ds.memory_usage().vectorWaste; }},
+        {"clear_all", [](Datastructures& ds, Dataset const&, unsigned int) {
+            ds.clear_all(); }, true, nullptr, 1},
+    };
+    return list;
+}
+
+struct Result
+{
+    // Mean, median and minimum of the samples left after outlier rejection, in ns/op
+    double mean = 0;
+    double median = 0;
+    double min = 0;
+    unsigned int kept = 0;
+    unsigned int batch = 0;
+};
+
+double median_of(std::vector<double> values)
+{
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    if (values.size() % 2 == 1) {
+        return *middle;
+    }
+    return (*middle + *std::max_element(values.begin(), middle)) / 2;
+}
+
+// Times batch operations, returns nanoseconds per operation
+double run_sample(Benchmark const& bench, Datastructures& ds, Dataset const& data, unsigned int batch)
+{
+    auto start = Clock::now();
+    for (unsigned int i = 0; i < batch; ++i) {
+        bench.op(ds, data, i);
+    }
+    auto end = Clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / batch;
+}
+
+Result measure(Benchmark const& bench, Dataset const& data, unsigned int warmup, unsigned int reps)
+{
+    Datastructures ds;
+    auto prepare = [&bench, &data](Datastructures& target) {
+        build(target, data);
+        if (bench.prepare) {
+            bench.prepare(target, data);
+        }
+    };
+
+    Result result;
+    std::function<double()> sample;
+    if (bench.mutating) {
+        // Every sample starts from the same contents, the rebuild isn't timed
+        result.batch = std::min(bench.maxBatch, data.pool_size());
+        sample = [&]() {
+            Datastructures fresh;
+            prepare(fresh);
+            return run_sample(bench, fresh, data, result.batch);
+        };
+    } else {
+        // Double the batch until a sample is long enough for the clock resolution, this also warms up
+        prepare(ds);
+        result.batch = 1;
+        while (result.batch < bench.maxBatch
+               && run_sample(bench, ds, data, result.batch) * result.batch < std::chrono::duration<double, std::nano>(MIN_SAMPLE_TIME).count()) {
+            result.batch *= 2;
+        }
+        sample = [&]() { return run_sample(bench, ds, data, result.batch); };
+    }
+
+    for (unsigned int i = 0; i < warmup; ++i) {
+        sample();
+    }
+    std::vector<double> samples;
+    for (unsigned int i = 0; i < reps; ++i) {
+        samples.push_back(sample());
+    }
+
+    // Reject the samples disturbed by e.g. interrupts or other processes
+    double median = median_of(samples);
+    std::vector<double> deviations;
+    for (double value : samples) {
+        deviations.push_back(std::abs(value - median));
+    }
+    double limit = OUTLIER_MADS * 1.4826 * median_of(deviations);
+    std::vector<double> kept;
+    for (double value : samples) {
+        if (std::abs(value - median) <= limit) {
+            kept.push_back(value);
+        }
+    }
+    if (kept.empty()) {
+        kept = samples;
+    }
+
+    result.mean = std::accumulate(kept.begin(), kept.end(), 0.0) / kept.size();
+    result.median = median_of(kept);
+    result.min = *std::min_element(kept.begin(), kept.end());
+    result.kept = kept.size();
+    return result;
+}
+
+bool parse_unsigned(std::string const& str, unsigned int& value)
+{
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    value = std::stoul(str);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<unsigned int> sizes = {1000, 10000, 100000};
+    unsigned int reps = 7;
+    unsigned int warmup = 2;
+    std::string filter;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg.compare(0, 8, "--sizes=") == 0) {
+            sizes.clear();
+            std::istringstream sizestream(arg.substr(8));
+            std::string size;
+            while (ok && std::getline(sizestream, size, ',')) {
+                sizes.push_back(0);
+                ok = parse_unsigned(size, sizes.back()) && sizes.back() > 0;
+            }
+            ok = ok && !sizes.empty();
+        } else if (arg.compare(0, 7, "--reps=") == 0) {
+            ok = parse_unsigned(arg.substr(7), reps) && reps > 0;
+        } else if (arg.compare(0, 9, "--warmup=") == 0) {
+            ok = parse_unsigned(arg.substr(9), warmup);
+        } else if (arg.compare(0, 2, "--") != 0 && filter.empty()) {
+            filter = arg;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Usage: " << argv[0] << " [--sizes=1000,10000,100000] [--reps=7] [--warmup=2] [filter]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << std::left << std::setw(38) << "operation" << std::right << std::setw(8) << "size"
+              << std::setw(14) << "ns/op" << std::setw(14) << "median" << std::setw(14) << "min"
+              << std::setw(8) << "kept" << std::setw(10) << "batch" << std::endl;
+
+    std::mt19937 gen(1);
+    for (auto size : sizes) {
+        Dataset data = generate_dataset(size, gen);
+        for (auto const& bench : benchmarks()) {
+            if (bench.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            Result result = measure(bench, data, warmup, reps);
+            std::cout << std::left << std::setw(38) << bench.name << std::right << std::setw(8) << size
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(14) << result.mean << std::setw(14) << result.median << std::setw(14) << result.min
+                      << std::setw(8) << (std::to_string(result.kept) + "/" + std::to_string(reps))
+                      << std::setw(10) << result.batch << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
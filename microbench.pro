@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Microbenchmarks for the individual Datastructures operations,
+# see microbench.cc. Doesn't need Qt libraries.
+#
+#-------------------------------------------------
+
+CONFIG += c++17 warn_on console
+CONFIG -= qt app_bundle
+
+TARGET = microbench
+TEMPLATE = app
+
+SOURCES += \
+    datastructures.cc \
+    microbench.cc \
+    tracing.cc
+
+HEADERS += \
+    datastructures.hh \
+    tracing.hh
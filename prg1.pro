@@ -17,6 +17,21 @@
 # "Rebuild all" from the Build menu
 #  QMAKE_CXXFLAGS += -DUSE_PERF_EVENT
 
+# Uncomment the line below to count heap allocations (number of allocations, bytes allocated and
+# peak live bytes) for each command run with the stopwatch on, and for the add/cmds phases of perftest
+# NOTE 1: Counting replaces the global operator new/delete, which makes every allocation a bit slower.
+# NOTE 2: If you uncomment or recomment the line, remember to recompile EVERYTHING by selecting
+# "Rebuild all" from the Build menu
+#  QMAKE_CXXFLAGS += -DUSE_ALLOC_COUNT
+
+# Uncomment the line below to count the calls of each Datastructures operation, lookup hits and misses,
+# rebuilds of the sorted vectors, reference chain steps and returned elements. The stats command
+# prints the counters and resets them.
+# NOTE 1: The counters are relaxed atomics, but they still make every operation a bit slower.
+# NOTE 2: If you uncomment or recomment the line, remember to recompile EVERYTHING by selecting
+# "Rebuild all" from the Build menu
+#  QMAKE_CXXFLAGS += -DUSE_OP_STATS
+
 QT       += core gui
 
 CONFIG += c++17 warn_on
@@ -41,12 +56,14 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     datastructures.cc \
     mainwindow.cc \
-    mainprogram.cc
+    mainprogram.cc \
+    tracing.cc
 
 HEADERS += \
     datastructures.hh \
     mainwindow.hh \
-    mainprogram.hh
+    mainprogram.hh \
+    tracing.hh
 
 exists(worldmap/worldmap.hh) {
     HEADERS += worldmap/worldmap.hh
@@ -56,9 +73,15 @@ FORMS += \
     mainwindow.ui
 
 
-# If you uncomment the lines below and recompile EVERYTHING (by selecting "Rebuild all" from the Build menu),
-# you'll get a non-graphical command line version of the program (just like if you had compiled the program
-# directly using the g++ command.
-#FORMS -= mainprogram.ui
-#CONFIG -= core gui qt
-#CONFIG += console
+# If you uncomment the line below (or run qmake with CONFIG+=console_only) and recompile EVERYTHING
+# (by selecting "Rebuild all" from the Build menu), you'll get a non-graphical command line version of
+# the program, which doesn't need Qt libraries to run (just like if you had compiled the program
+# directly using the g++ command). CMakeLists.txt builds the same version without needing Qt at all.
+#CONFIG += console_only
+
+console_only {
+    FORMS -= mainwindow.ui
+    QT -= core gui widgets
+    CONFIG -= qt app_bundle
+    CONFIG += console
+}
@@ -0,0 +1,163 @@
+// Tracing.cc
+
+#include "tracing.hh"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> trace_enabled{false};
+
+namespace
+{
+
+// Events kept per thread, older events are overwritten when the buffer is full
+std::size_t const TRACE_BUFFER_SIZE = 1 << 16;
+
+struct TraceEvent
+{
+    char const* name;
+    TraceScope::Clock::time_point start;
+    TraceScope::Clock::duration duration;
+};
+
+// Ring buffer of one thread. The mutex is only contended while a trace is being written.
+struct TraceBuffer
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    // Number of events recorded since the trace was started, the next one goes to recorded % TRACE_BUFFER_SIZE
+    unsigned long long recorded = 0;
+    unsigned int tid = 0;
+    char const* name = nullptr;
+};
+
+std::mutex registry_mutex;
+// Buffers of all the threads that have recorded events, kept after the thread exits
+std::vector<std::shared_ptr<TraceBuffer>> registry;
+unsigned int next_tid = 1;
+TraceScope::Clock::time_point trace_origin;
+
+thread_local std::shared_ptr<TraceBuffer> local_buffer;
+// Name given with trace_thread_name, the buffer is created only when the thread records something
+thread_local char const* local_name = nullptr;
+
+TraceBuffer& thread_buffer()
+{
+    if (!local_buffer) {
+        local_buffer = std::make_shared<TraceBuffer>();
+        local_buffer->events.reserve(TRACE_BUFFER_SIZE);
+        local_buffer->name = local_name;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        local_buffer->tid = next_tid++;
+        registry.push_back(local_buffer);
+    }
+    return *local_buffer;
+}
+
+void write_json_string(std::ostream& output, char const* str)
+{
+    output << '"';
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') { output << '\\'; }
+        output << *str;
+    }
+    output << '"';
+}
+
+} // namespace
+
+void TraceScope::record(char const* name, Clock::time_point start, Clock::time_point end)
+{
+    TraceBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    TraceEvent event{name, start, end - start};
+    if (buffer.events.size() < TRACE_BUFFER_SIZE) {
+        buffer.events.push_back(event);
+    } else {
+        buffer.events[buffer.recorded % TRACE_BUFFER_SIZE] = event;
+    }
+    ++buffer.recorded;
+}
+
+void trace_start()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    trace_enabled.store(false, std::memory_order_relaxed);
+
+    // Buffers of the threads that have exited aren't needed any more
+    std::vector<std::shared_ptr<TraceBuffer>> alive;
+    for (auto& buffer : registry) {
+        if (buffer.use_count() > 1) {
+            std::lock_guard<std::mutex> bufferlock(buffer->mutex);
+            buffer->events.clear();
+            buffer->recorded = 0;
+            alive.push_back(buffer);
+        }
+    }
+    registry = std::move(alive);
+
+    trace_origin = TraceScope::Clock::now();
+    trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void trace_thread_name(char const* name)
+{
+    local_name = name;
+    if (local_buffer) {
+        std::lock_guard<std::mutex> lock(local_buffer->mutex);
+        local_buffer->name = name;
+    }
+}
+
+bool trace_stop(std::string const& filename, unsigned long long& events, unsigned long long& dropped)
+{
+    trace_enabled.store(false, std::memory_order_relaxed);
+    events = 0;
+    dropped = 0;
+
+    std::ofstream output(filename);
+    if (!output) { return false; }
+
+    // Timestamps are in microseconds from the start of the trace
+    auto micros = [](TraceScope::Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+    output << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (auto& buffer : registry) {
+        std::lock_guard<std::mutex> bufferlock(buffer->mutex);
+        if (buffer->recorded == 0) { continue; }
+
+        output << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+               << ",\"args\":{\"name\":";
+        if (buffer->name) {
+            write_json_string(output, buffer->name);
+        } else {
+            output << '"' << (buffer->tid == 1 ? "main" : "thread " + std::to_string(buffer->tid)) << '"';
+        }
+        output << "}}";
+        first = false;
+
+        // Oldest event first
+        std::size_t count = buffer->events.size();
+        std::size_t oldest = buffer->recorded > count ? buffer->recorded % TRACE_BUFFER_SIZE : 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            TraceEvent const& event = buffer->events[(oldest + i) % count];
+            output << ",\n{\"name\":";
+            write_json_string(output, event.name);
+            output << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                   << ",\"ts\":" << micros(event.start - trace_origin) << ",\"dur\":" << micros(event.duration) << "}";
+        }
+        events += count;
+        dropped += buffer->recorded - count;
+    }
+    output << std::endl << "]}" << std::endl;
+
+    return static_cast<bool>(output);
+}
@@ -0,0 +1,64 @@
+// Tracing.hh
+//
+// Lightweight scoped tracing. While a trace is being recorded, every TRACE_SCOPE
+// records its start time and duration into a ring buffer of the current thread.
+// The recorded events are written as Chrome trace-event JSON, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev.
+// When no trace is being recorded, a scope costs one relaxed atomic load.
+
+#ifndef TRACING_HH
+#define TRACING_HH
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// True while a trace is being recorded
+extern std::atomic<bool> trace_enabled;
+
+// Starts recording a new trace, discarding the events of the previous one
+void trace_start();
+
+// Stops recording and writes the recorded events to filename. Returns false if the file
+// couldn't be written. Events and dropped are set to the number of events written and
+// the number of events lost because a ring buffer was full.
+bool trace_stop(std::string const& filename, unsigned long long& events, unsigned long long& dropped);
+
+// Names the calling thread in the written traces. Unnamed threads are shown as "main" if they
+// recorded first and otherwise by their number.
+void trace_thread_name(char const* name);
+
+class TraceScope
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Name has to outlive the trace, string literals are fine
+    explicit TraceScope(char const* name)
+        : name_(name), active_(trace_enabled.load(std::memory_order_relaxed))
+    {
+        if (active_) { start_ = Clock::now(); }
+    }
+
+    ~TraceScope()
+    {
+        if (active_) { record(name_, start_, Clock::now()); }
+    }
+
+    TraceScope(TraceScope const&) = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+
+private:
+    static void record(char const* name, Clock::time_point start, Clock::time_point end);
+
+    char const* name_;
+    bool active_;
+    Clock::time_point start_;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// Traces the rest of the enclosing block
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif // TRACING_HH